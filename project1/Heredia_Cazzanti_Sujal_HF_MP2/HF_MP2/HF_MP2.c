@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../common/integrals.h"
+#include "../common/hf.h"
+#include "../common/mp2.h"
+#include "../common/report.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//Combined driver: E(HF) and E(MP2) from a single read of each TREXIO file.
+//With one file it prints the detailed energies. With several files, or a directory (all its *.h5 files), the
+//files are processed by a pool of worker threads and a results table is printed at the end. TREXIO calls are
+//serialized (see eri_stream_lock), so while one worker reads its file the others compute their energies.
+
+//TREXIO file read when none is given on the command line
+#ifndef HF_MP2_INPUT_FILE
+#define HF_MP2_INPUT_FILE "h2o.h5"
+#endif
+
+#define DEFAULT_JOBS 2 //Default number of files processed at the same time
+
+typedef struct {
+	char* filename;
+	trexio_exit_code status; //TREXIO_SUCCESS, or the error met while reading the file
+	int mo, num_elec;
+	double e_hf;             //E(HF)
+	double e_corr;           //MP2 correlation energy
+	double seconds;          //Wall time spent on this file
+} batch_result_t;
+
+typedef struct {
+	batch_result_t* results;
+	report_t* reports;       //Phase times and counters of each file
+	int nfiles;
+	int next;                //Next file to hand out
+	pthread_mutex_t lock;    //Protects 'next'
+	const integrals_options_t* opts;
+	const mp2_options_t* mp2_opts;
+	int omp_threads;         //OpenMP threads given to each worker for the MP2 kernel
+	int with_report;         //Fill the per-file reports
+} batch_queue_t;
+
+static void* batch_worker(void* arg){
+	batch_queue_t* queue = (batch_queue_t*)arg;
+#ifdef _OPENMP
+	omp_set_num_threads(queue->omp_threads); //Per-thread setting: the workers do not oversubscribe the node
+#endif
+
+	for (;;){
+		pthread_mutex_lock(&queue->lock);
+		int f = queue->next++;
+		pthread_mutex_unlock(&queue->lock);
+		if ( f >= queue->nfiles ) break;
+
+		batch_result_t* res = &queue->results[f];
+		report_t* report = &queue->reports[f];
+		report_init(report);
+		report_set_current(queue->with_report ? report : NULL);
+
+		double t0 = report_time();
+		integrals_t ints;
+		res->status = integrals_load(res->filename, queue->opts, &ints);
+		if ( res->status == TREXIO_SUCCESS ){
+			double t_energy = report_time();
+			hf_energy_t hf;
+			hf_energy(&ints, &hf);
+			res->e_hf = hf.total;
+			mp2_stats_t stats;
+			res->e_corr = mp2_energy(&ints, queue->mp2_opts, &stats);
+			REPORT_TIME(REPORT_ENERGY, t_energy);
+			res->mo = ints.mo;
+			res->num_elec = ints.num_elec;
+			report_energy(report, "hf", res->e_hf);
+			report_energy(report, "mp2_correlation", res->e_corr);
+			report_energy(report, "mp2", res->e_hf + res->e_corr);
+			if ( queue->opts->cholesky_threshold > 0.0 ) report_energy(report, "cholesky_error", ints.ovov_factors.error);
+			if ( stats.laplace_points > 0 ) report_energy(report, "laplace_error", stats.laplace_error);
+			if ( queue->mp2_opts->screen_tol > 0.0 ) report_energy(report, "screening_bound", stats.screened_bound);
+		}
+		double t_free = report_time();
+		integrals_free(&ints);
+		REPORT_TIME(REPORT_TEARDOWN, t_free);
+		if ( res->status == TREXIO_SUCCESS && queue->opts->precision_check && queue->opts->mp2_precision != STORE_DOUBLE ){
+			report_energy(report, "precision_deviation",
+			              res->e_corr - mp2_reference_energy(res->filename, queue->opts, queue->mp2_opts));
+		}
+		res->seconds = report_time() - t0;
+	}
+	return NULL;
+}
+
+static int is_h5(const struct dirent* entry){
+	size_t len = strlen(entry->d_name);
+	return len > 3 && strcmp(entry->d_name + len - 3, ".h5") == 0;
+}
+
+//Appends 'path' to the list of files, or all the *.h5 files inside it (in alphabetical order) if it is a directory
+static void add_input(const char* path, char*** files, int* nfiles, int* capacity){
+	struct stat st;
+	struct dirent** entries = NULL;
+	int nentries = 0;
+	int is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+
+	if ( is_dir ){
+		nentries = scandir(path, &entries, is_h5, alphasort);
+		if ( nentries < 0 ){
+			printf("Cannot read the directory %s\n", path);
+			exit(1);
+		}
+	}
+
+	int nnew = is_dir ? nentries : 1;
+	if ( *nfiles + nnew > *capacity ){
+		*capacity = 2*(*nfiles + nnew);
+		*files = realloc(*files, (size_t)*capacity*sizeof(char*));
+		if ( *files == NULL ){
+			printf("Memory allocation went wrong");
+			exit(1);
+		}
+	}
+
+	if ( !is_dir ){
+		(*files)[(*nfiles)++] = strdup(path);
+		return;
+	}
+	for (int e=0; e<nentries; e++){
+		char* full = malloc(strlen(path) + strlen(entries[e]->d_name) + 2);
+		if ( full == NULL ){
+			printf("Memory allocation went wrong");
+			exit(1);
+		}
+		sprintf(full, "%s/%s", path, entries[e]->d_name);
+		(*files)[(*nfiles)++] = full;
+		free(entries[e]);
+	}
+	free(entries);
+}
+
+static void usage(const char* program){
+	printf("Usage: %s " INTEGRALS_OPTIONS_USAGE " " INTEGRALS_MP2_OPTIONS_USAGE " " MP2_OPTIONS_USAGE " " REPORT_OPTIONS_USAGE " [--jobs N] [FILE|DIRECTORY ...]   (SIZE in bytes, or with a K/M/G suffix)\n", program);
+	exit(1);
+}
+
+int main(int argc, char** argv){
+	//////////////////////////////////// COMMAND LINE OPTIONS ///////////////////////////////////////////
+	integrals_options_t opts; //How the integrals are read (see common/integrals.h)
+	integrals_default_options(&opts);
+	opts.want_hf = 1;
+	opts.want_mp2 = 1;
+
+	mp2_options_t mp2_opts; //How the MP2 energy is evaluated (see common/mp2.h)
+	mp2_default_options(&mp2_opts);
+
+	int jobs = DEFAULT_JOBS; //Files processed at the same time in batch mode
+	char** files = NULL;     //Input files
+	int nfiles = 0, capacity = 0;
+	int batch = 0;           //Several files, or a directory, were given
+	const char* report_path = NULL; //JSON run report (--report), none by default
+
+	for (int k=1; k<argc; k++){
+		if ( integrals_parse_option(argc, argv, &k, &opts) ) continue;
+		if ( integrals_parse_mp2_option(argc, argv, &k, &opts) ) continue;
+		if ( mp2_parse_option(argc, argv, &k, &mp2_opts) ) continue;
+		if ( report_parse_option(argc, argv, &k, &report_path) ) continue;
+
+		if ( strcmp(argv[k], "--jobs") == 0 && k+1 < argc ){
+			jobs = atoi(argv[++k]);
+			if ( jobs < 1 ) usage(argv[0]);
+		}
+		else if ( argv[k][0] == '-' ){
+			usage(argv[0]);
+		}
+		else{
+			struct stat st;
+			if ( stat(argv[k], &st) == 0 && S_ISDIR(st.st_mode) ) batch = 1;
+			add_input(argv[k], &files, &nfiles, &capacity);
+		}
+	}
+	if ( nfiles > 1 ) batch = 1;
+	if ( nfiles == 0 && !batch ) add_input(HF_MP2_INPUT_FILE, &files, &nfiles, &capacity);
+	if ( nfiles == 0 ){
+		printf("No .h5 file found\n");
+		exit(1);
+	}
+	if ( batch && mp2_opts.checkpoint != NULL ){
+		printf("--checkpoint needs a single input file\n");
+		exit(1);
+	}
+	if ( mp2_opts.restart && mp2_opts.checkpoint == NULL ){
+		printf("--restart needs --checkpoint FILE\n");
+		exit(1);
+	}
+
+	if ( !batch ){
+		///////////////////////////////////////////// SINGLE FILE ////////////////////////////////////////
+		//One pass over the file fills both the HF and the MP2 stores
+		report_t report;
+		report_init(&report);
+		if ( report_path != NULL ) report_set_current(&report);
+
+		integrals_t ints;
+		if ( integrals_load(files[0], &opts, &ints) != TREXIO_SUCCESS ) exit(1);
+		if ( ints.window.nfrozen > 0 || ints.window.ndropped > 0 ){
+			printf("MP2 window: %d frozen core, %d active occupied, %d active virtual, %d virtual dropped \n",
+			       ints.window.nfrozen, ints.window.nocc, ints.window.nvirt, ints.window.ndropped);
+		}
+
+		double t0 = report_time();
+		hf_energy_t hf;
+		hf_energy(&ints, &hf);
+		mp2_stats_t stats;
+		double emp2 = mp2_energy(&ints, &mp2_opts, &stats);
+		REPORT_TIME(REPORT_ENERGY, t0);
+
+		printf("Nuclear repulsion energy: %f \n", hf.nuclear);
+		printf("One electron energy: %f \n", hf.one_el);
+		printf("Two electron energy: %f \n", hf.two_el);
+		printf("E(HF): %f \n", hf.total);
+		if ( ints.ovov_factors.B != NULL ){
+			printf("Cholesky vectors: %d, decomposition error: %e \n", ints.ovov_factors.naux, ints.ovov_factors.error);
+		}
+		if ( stats.tile > 0 ) printf("MP2 tile: %d virtual orbitals \n", stats.tile);
+		if ( stats.isa != MP2_ISA_AUTO ) printf("MP2 SIMD kernel: %s \n", mp2_isa_name(stats.isa));
+		if ( stats.laplace_points > 0 ){
+			printf("Laplace points: %d, quadrature error: %e \n", stats.laplace_points, stats.laplace_error);
+		}
+		if ( mp2_opts.screen_tol > 0.0 ){
+			printf("Screened terms: %ld of %ld, neglected energy bound: %e \n", (long)stats.screened_terms,
+			       (long)stats.total_terms, stats.screened_bound);
+		}
+		printf("MP2 correlation energy: %f \n", emp2);
+		printf("E(MP2): %f \n", hf.total + emp2);
+		double cholesky_error = ints.ovov_factors.error;
+
+		t0 = report_time();
+		integrals_free(&ints);
+		REPORT_TIME(REPORT_TEARDOWN, t0);
+
+		//Reduced precision store checked against the double precision one, read after this one is released
+		int check = ( opts.precision_check && opts.mp2_precision != STORE_DOUBLE );
+		double deviation = 0.0;
+		if ( check ){
+			deviation = emp2 - mp2_reference_energy(files[0], &opts, &mp2_opts);
+			printf("Deviation from the double precision MP2 store: %e \n", deviation);
+		}
+
+		if ( report_path != NULL ){
+			report_energy(&report, "hf", hf.total);
+			report_energy(&report, "mp2_correlation", emp2);
+			report_energy(&report, "mp2", hf.total + emp2);
+			if ( opts.cholesky_threshold > 0.0 ) report_energy(&report, "cholesky_error", cholesky_error);
+			if ( stats.laplace_points > 0 ) report_energy(&report, "laplace_error", stats.laplace_error);
+			if ( mp2_opts.screen_tol > 0.0 ) report_energy(&report, "screening_bound", stats.screened_bound);
+			if ( check ) report_energy(&report, "precision_deviation", deviation);
+			if ( !report_write(report_path, "HF_MP2", (const char* const*)files, &report, 1) ){
+				printf("Cannot write the report %s\n", report_path);
+				exit(1);
+			}
+		}
+	}
+	else{
+		///////////////////////////////////////////// BATCH MODE /////////////////////////////////////////
+		if ( jobs > nfiles ) jobs = nfiles;
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+		batch_queue_t queue;
+		queue.results = calloc((size_t)nfiles, sizeof(batch_result_t));
+		queue.reports = calloc((size_t)nfiles, sizeof(report_t));
+		pthread_t* workers = malloc((size_t)jobs*sizeof(pthread_t));
+		if ( queue.results == NULL || queue.reports == NULL || workers == NULL ){
+			printf("Memory allocation went wrong");
+			exit(1);
+		}
+		for (int f=0; f<nfiles; f++) queue.results[f].filename = files[f];
+		queue.nfiles = nfiles;
+		queue.next = 0;
+		queue.opts = &opts;
+		queue.mp2_opts = &mp2_opts;
+		queue.omp_threads = (cores > jobs) ? (int)(cores/jobs) : 1;
+		queue.with_report = (report_path != NULL);
+		pthread_mutex_init(&queue.lock, NULL);
+
+		double t0 = report_time();
+		for (int w=0; w<jobs; w++){
+			if ( pthread_create(&workers[w], NULL, batch_worker, &queue) != 0 ){
+				printf("Cannot start worker thread\n");
+				exit(1);
+			}
+		}
+		for (int w=0; w<jobs; w++) pthread_join(workers[w], NULL);
+		double elapsed = report_time() - t0;
+
+		//Results table, in the order the files were given
+		printf("\n%-32s %5s %5s %18s %18s %18s %10s\n", "File", "MO", "Occ", "E(HF)", "E(MP2) corr.", "E(MP2)", "Time (s)");
+		int failed = 0;
+		for (int f=0; f<nfiles; f++){
+			batch_result_t* res = &queue.results[f];
+			if ( res->status != TREXIO_SUCCESS ){
+				printf("%-32s failed: %s\n", res->filename, trexio_string_of_error(res->status));
+				failed++;
+				continue;
+			}
+			printf("%-32s %5d %5d %18.8f %18.8f %18.8f %10.3f\n", res->filename, res->mo, res->num_elec,
+			       res->e_hf, res->e_corr, res->e_hf + res->e_corr, res->seconds);
+		}
+		printf("%d files (%d failed) in %.3f s with %d workers \n", nfiles, failed, elapsed, jobs);
+
+		if ( report_path != NULL && !report_write(report_path, "HF_MP2", (const char* const*)files, queue.reports, nfiles) ){
+			printf("Cannot write the report %s\n", report_path);
+			failed++;
+		}
+
+		pthread_mutex_destroy(&queue.lock);
+		free(queue.results);
+		free(queue.reports);
+		free(workers);
+		if ( failed > 0 ){
+			for (int f=0; f<nfiles; f++) free(files[f]);
+			free(files);
+			exit(1);
+		}
+	}
+
+	/////////////////////////////////////// MEMORY DEALLOCATION PHASE ///////////////////////////////////
+	for (int f=0; f<nfiles; f++) free(files[f]);
+	free(files);
+}
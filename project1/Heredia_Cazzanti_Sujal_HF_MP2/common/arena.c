@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+static size_t page_size(void){
+	long page = sysconf(_SC_PAGESIZE);
+	return (page > 0) ? (size_t)page : 4096;
+}
+
+void arena_init(arena_t* arena, size_t size, int huge_pages){
+	memset(arena, 0, sizeof(*arena));
+	arena->huge_pages = huge_pages;
+
+	size_t page = page_size();
+	size = (size > 0) ? (size + page - 1) / page * page : page;
+	void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if ( base == MAP_FAILED ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+	arena->base = (char*)base;
+	arena->size = size;
+#ifdef MADV_HUGEPAGE
+	if ( huge_pages && madvise(arena->base, arena->size, MADV_HUGEPAGE) != 0 ){
+		printf("Transparent huge pages not available, continuing with normal pages\n");
+		arena->huge_pages = 0;
+	}
+#else
+	if ( huge_pages ){
+		printf("Transparent huge pages not available, continuing with normal pages\n");
+		arena->huge_pages = 0;
+	}
+#endif
+}
+
+void* arena_alloc(arena_t* arena, size_t bytes){
+	size_t start = arena->used; //Always a multiple of ARENA_ALIGNMENT
+	bytes = arena_round(bytes);
+	if ( bytes > arena->size - start ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+	arena->used = start + bytes;
+	if ( arena->used + arena->heap > arena->high_water ) arena->high_water = arena->used + arena->heap;
+	//No memset: everything above 'used' is zero, untouched pages as mapped and released ones cleared by
+	//arena_release
+	return arena->base + start;
+}
+
+size_t arena_mark(const arena_t* arena){
+	return arena->used;
+}
+
+void arena_release(arena_t* arena, size_t mark){
+	if ( mark >= arena->used ) return;
+	//The whole pages above the mark go back to the system at once, the partial one is cleared for the next
+	//allocations
+	size_t page = page_size();
+	size_t first_page = (mark + page - 1) / page * page;
+	if ( first_page > arena->used ) first_page = arena->used;
+	memset(arena->base + mark, 0, first_page - mark);
+	if ( arena->used > first_page ){
+		size_t length = (arena->used - first_page + page - 1) / page * page;
+#ifdef MADV_DONTNEED
+		if ( madvise(arena->base + first_page, length, MADV_DONTNEED) != 0 )
+#endif
+		{
+			memset(arena->base + first_page, 0, arena->used - first_page);
+		}
+	}
+	arena->used = mark;
+}
+
+void arena_heap_add(arena_t* arena, size_t bytes){
+	arena->heap += bytes;
+	if ( arena->used + arena->heap > arena->high_water ) arena->high_water = arena->used + arena->heap;
+}
+
+void arena_heap_sub(arena_t* arena, size_t bytes){
+	arena->heap = (bytes < arena->heap) ? arena->heap - bytes : 0;
+}
+
+int arena_owns(const arena_t* arena, const void* ptr){
+	const char* p = (const char*)ptr;
+	return arena->base != NULL && p >= arena->base && p < arena->base + arena->size;
+}
+
+void arena_free(arena_t* arena){
+	if ( arena->base != NULL ) munmap(arena->base, arena->size);
+	arena->base=NULL;
+	arena->size=0;
+	arena->used=0;
+}
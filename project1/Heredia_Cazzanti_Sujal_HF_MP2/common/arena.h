@@ -0,0 +1,55 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+///////////////////////////////////// MEMORY ARENA //////////////////////////
+//The buffers of an integral context are carved, 64 bytes aligned, out of one range of memory mapped up front: an
+//allocation is a pointer bump, with no malloc bookkeeping between the buffers. The range is sized by its owner from
+//what it will allocate (see arena_round), so that several contexts of a batch run only take what they need. The
+//pages are only backed by memory when first written. With huge pages (--huge-pages) the range is advised for
+//transparent huge pages, which cuts the TLB misses of the large integral stores.
+//Allocations are released in stack order: arena_mark() before the temporary buffers of a phase (chunk buffers of
+//the reader, scratch of the sort, ...) and arena_release() once the phase is over, which returns their pages to the
+//system right away. The arena remembers its high-water mark, the peak memory of the context. The few buffers that
+//cannot follow the stack order (they grow, or outlive a buffer allocated before them) stay on the heap and are
+//declared with arena_heap_add/arena_heap_sub, so that the high-water mark still counts them.
+
+#define ARENA_ALIGNMENT 64 //Cache line size, also suits AVX-512 loads
+
+typedef struct {
+	char* base;        //Reserved range, NULL before arena_init
+	size_t size;       //Bytes reserved
+	size_t used;       //Bytes allocated, the next allocation starts there
+	size_t heap;       //Heap bytes declared alive next to the arena
+	size_t high_water; //Largest 'used' + 'heap' so far
+	int huge_pages;    //Range advised for transparent huge pages
+} arena_t;
+
+//Bytes an allocation of 'bytes' takes in an arena: the sum of them over the buffers alive at the same time sizes it
+static inline size_t arena_round(size_t bytes){
+	if ( bytes == 0 ) return ARENA_ALIGNMENT; //Distinct pointers for empty buffers
+	return (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
+
+//Maps 'size' bytes for the arena. Exits if the memory is not available.
+void arena_init(arena_t* arena, size_t size, int huge_pages);
+
+//'bytes' zeroed bytes, 64-byte aligned. Exits if the arena is full, i.e. if its size was underestimated.
+void* arena_alloc(arena_t* arena, size_t bytes);
+
+//Checkpoint: everything allocated after it is released by arena_release
+size_t arena_mark(const arena_t* arena);
+void arena_release(arena_t* arena, size_t mark);
+
+//Declares 'bytes' of heap memory allocated or freed next to the arena, for its high-water mark
+void arena_heap_add(arena_t* arena, size_t bytes);
+void arena_heap_sub(arena_t* arena, size_t bytes);
+
+//Whether 'ptr' was allocated from the arena (those buffers are never passed to free)
+int arena_owns(const arena_t* arena, const void* ptr);
+
+//Releases the whole range
+void arena_free(arena_t* arena);
+
+#endif
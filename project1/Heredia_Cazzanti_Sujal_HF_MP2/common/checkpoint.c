@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "report.h"
+
+#define CHECKPOINT_MAGIC "MP2CKPT\0"
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	int32_t npairs;
+	uint64_t fingerprint;
+	uint64_t endian_check;  //Written as 1, reads differently on a machine with another byte order
+} checkpoint_header_t;
+
+uint64_t checkpoint_hash(uint64_t hash, const void* data, size_t bytes){
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t m=0; m<bytes; m++){
+		hash ^= p[m];
+		hash *= 1099511628211ULL; //FNV prime
+	}
+	return hash;
+}
+
+int checkpoint_load(mp2_checkpoint_t* ck){
+	FILE* f = fopen(ck->path, "rb");
+	if ( f == NULL ) return 0;
+
+	int n = ck->npairs;
+	checkpoint_header_t header;
+	char* done = malloc((size_t)n + 1);
+	double* energy = malloc((size_t)n*sizeof(double) + 1);
+	double* bound = malloc((size_t)n*sizeof(double) + 1);
+	int64_t* screened = malloc((size_t)n*sizeof(int64_t) + 1);
+	if ( done == NULL || energy == NULL || bound == NULL || screened == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+
+	//Everything is read into scratch arrays first, so a truncated or foreign file leaves the run untouched
+	int valid = fread(&header, sizeof(header), 1, f) == 1
+	         && memcmp(header.magic, CHECKPOINT_MAGIC, 8) == 0
+	         && header.version == CHECKPOINT_VERSION
+	         && header.endian_check == 1
+	         && header.npairs == n
+	         && header.fingerprint == ck->fingerprint
+	         && fread(done, 1, (size_t)n, f) == (size_t)n
+	         && fread(energy, sizeof(double), (size_t)n, f) == (size_t)n
+	         && fread(bound, sizeof(double), (size_t)n, f) == (size_t)n
+	         && fread(screened, sizeof(int64_t), (size_t)n, f) == (size_t)n;
+	fclose(f);
+
+	int restored = 0;
+	if ( valid ){
+		for (int ij=0; ij<n; ij++){
+			if ( !done[ij] ) continue;
+			ck->done[ij] = 1;
+			ck->energy[ij] = energy[ij];
+			ck->bound[ij] = bound[ij];
+			ck->screened[ij] = screened[ij];
+			restored++;
+		}
+	}
+	else{
+		printf("Checkpoint %s does not belong to this run, starting from scratch \n", ck->path);
+	}
+
+	free(done);
+	free(energy);
+	free(bound);
+	free(screened);
+	return restored;
+}
+
+int checkpoint_write(mp2_checkpoint_t* ck){
+	char* tmp_path = malloc(strlen(ck->path) + 32);
+	if ( tmp_path == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+	sprintf(tmp_path, "%s.tmp%ld", ck->path, (long)getpid());
+
+	checkpoint_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+	header.version = CHECKPOINT_VERSION;
+	header.npairs = ck->npairs;
+	header.fingerprint = ck->fingerprint;
+	header.endian_check = 1;
+
+	size_t n = (size_t)ck->npairs;
+	int ok = 0;
+	FILE* f = fopen(tmp_path, "wb");
+	if ( f != NULL ){
+		ok = fwrite(&header, sizeof(header), 1, f) == 1
+		  && fwrite(ck->done, 1, n, f) == n
+		  && fwrite(ck->energy, sizeof(double), n, f) == n
+		  && fwrite(ck->bound, sizeof(double), n, f) == n
+		  && fwrite(ck->screened, sizeof(int64_t), n, f) == n;
+		ok = (fflush(f) == 0) && ok;
+		ok = (fsync(fileno(f)) == 0) && ok; //On disk before it replaces the previous checkpoint
+		ok = (fclose(f) == 0) && ok;
+		if ( ok ) ok = rename(tmp_path, ck->path) == 0;
+		if ( !ok ) remove(tmp_path);
+	}
+	if ( !ok ) printf("Could not write the checkpoint %s \n", ck->path);
+
+	free(tmp_path);
+	ck->last_write = report_time();
+	return ok;
+}
@@ -0,0 +1,44 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+///////////////////////////////////// MP2 CHECKPOINTS //////////////////////////
+//A long MP2 run saves the occupied pairs (i,j) it has completed, with their pair energies and screening counters, to
+//a checkpoint file every MP2_CHECKPOINT_INTERVAL seconds. With --restart a new run on the same input reads it back
+//and only computes the missing pairs. The pairs are independent and finish in any order under the dynamic
+//scheduler, so the file records each of them, not a count. It is written to a temporary file that is synced and
+//then renamed over the previous one: a run killed at any point leaves a complete checkpoint behind.
+//The header holds a fingerprint of everything the pair energies depend on (TREXIO file, active space, store
+//precision or Cholesky vectors, Laplace and screening options): a checkpoint of another run is never reused.
+
+#define CHECKPOINT_VERSION 1
+
+#ifndef MP2_CHECKPOINT_INTERVAL
+#define MP2_CHECKPOINT_INTERVAL 60.0 //Seconds between two checkpoints
+#endif
+
+typedef struct {
+	const char* path;     //Checkpoint file
+	uint64_t fingerprint; //Identity of the run
+	int npairs;           //Occupied pairs i<=j
+	char* done;           //1 for each completed pair [npairs]
+	double* energy;       //Weighted pair energies [npairs]
+	double* bound;        //Weighted screening bounds [npairs]
+	int64_t* screened;    //Screened out terms [npairs]
+	double last_write;    //report_time() of the last write
+} mp2_checkpoint_t;
+
+//FNV-1a hash of 'bytes' bytes of 'data', continuing from 'hash' (start from CHECKPOINT_HASH_SEED)
+#define CHECKPOINT_HASH_SEED 14695981039346656037ULL
+uint64_t checkpoint_hash(uint64_t hash, const void* data, size_t bytes);
+
+//Fills the completed pairs of 'ck' from its file if the file exists and matches the fingerprint. Returns the
+//number of pairs restored, 0 if there is no usable checkpoint.
+int checkpoint_load(mp2_checkpoint_t* ck);
+
+//Writes the current state of 'ck' atomically. Returns 1 on success, 0 otherwise (the previous file is kept).
+int checkpoint_write(mp2_checkpoint_t* ck);
+
+#endif
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef USE_CBLAS
+#include <cblas.h>
+#endif
+#include "cholesky.h"
+
+//Element M[q][p] of the (ia|jb) matrix, q = i*nvirt + a and p = j*nvirt + b
+static inline double ovov_element(const ovov_blocks_t* K, int q, int p){
+	int i = q / K->nvirt, a = q % K->nvirt;
+	int j = p / K->nvirt, b = p % K->nvirt;
+	return ovov_block(K, i, j)[(int64_t)a*K->nvirt + b];
+}
+
+void cholesky_decompose(const ovov_blocks_t* K, double threshold, arena_t* arena, size_t release,
+                        ovov_factors_t* factors){
+	int nvirt = K->nvirt;
+	int n = K->nocc*nvirt;
+
+	double* diag = arena_alloc(arena, (size_t)n*sizeof(double)); //Diagonal of the residual
+	double* L = NULL;    //Cholesky vectors L_P[q], one row of n doubles each. They grow, so on the heap.
+	int capacity = 0;
+	int naux = 0;
+	for (int q=0; q<n; q++) diag[q] = ovov_element(K, q, q);
+
+	for (;;){
+		//Pivot: largest residual diagonal element
+		int p = 0;
+		for (int q=1; q<n; q++){
+			if ( diag[q] > diag[p] ) p = q;
+		}
+		if ( n == 0 || diag[p] <= threshold || naux == n ) break;
+
+		if ( naux == capacity ){
+			int grown = (capacity == 0) ? 64 : 2*capacity;
+			if ( grown > n ) grown = n;
+			arena_heap_add(arena, (size_t)(grown - capacity)*n*sizeof(double));
+			capacity = grown;
+			L = realloc(L, (size_t)capacity*n*sizeof(double));
+			if ( L == NULL ){
+				printf("Memory allocation went wrong");
+				exit(1);
+			}
+		}
+
+		//New vector L_P[q] = (M[q][p] - sum_{P'<P} L_P'[q] L_P'[p]) / sqrt(residual M[p][p])
+		double* Lnew = L + (int64_t)naux*n;
+		double pivot = sqrt(diag[p]);
+		#pragma omp parallel for schedule(static)
+		for (int q=0; q<n; q++){
+			double value = ovov_element(K, q, p);
+			for (int P=0; P<naux; P++) value -= L[(int64_t)P*n + q] * L[(int64_t)P*n + p];
+			Lnew[q] = value / pivot;
+		}
+		for (int q=0; q<n; q++) diag[q] -= Lnew[q]*Lnew[q];
+		diag[p] = 0.0;
+		naux++;
+	}
+
+	double error = 0.0;
+	for (int q=0; q<n; q++){
+		if ( fabs(diag[q]) > error ) error = fabs(diag[q]);
+	}
+
+	//Vectors regrouped by occupied orbital, so that B_i[P][a] is one contiguous naux x nvirt matrix
+	arena_release(arena, release);
+	factors->nocc = K->nocc;
+	factors->nvirt = nvirt;
+	factors->naux = naux;
+	factors->error = error;
+	factors->B = arena_alloc(arena, (size_t)n*naux*sizeof(double));
+	for (int i=0; i<K->nocc; i++){
+		for (int P=0; P<naux; P++){
+			memcpy(factors->B + ((int64_t)i*naux + P)*nvirt, L + (int64_t)P*n + (int64_t)i*nvirt,
+			       (size_t)nvirt*sizeof(double));
+		}
+	}
+
+	free(L);
+	L=NULL;
+	arena_heap_sub(arena, (size_t)capacity*n*sizeof(double));
+	diag=NULL;
+}
+
+void cholesky_block(const ovov_factors_t* factors, int i, int j, double* Kij){
+	int nvirt = factors->nvirt;
+	int naux = factors->naux;
+	const double* Bi = factors->B + (int64_t)i*naux*nvirt;
+	const double* Bj = factors->B + (int64_t)j*naux*nvirt;
+
+#ifdef USE_CBLAS
+	cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans, nvirt, nvirt, naux,
+	            1.0, Bi, nvirt, Bj, nvirt, 0.0, Kij, nvirt);
+#else
+	memset(Kij, 0, (size_t)nvirt*nvirt*sizeof(double));
+	for (int P=0; P<naux; P++){
+		const double* Bi_P = Bi + (int64_t)P*nvirt;
+		const double* Bj_P = Bj + (int64_t)P*nvirt;
+		for (int a=0; a<nvirt; a++){
+			double* Kij_a = Kij + (int64_t)a*nvirt;
+			for (int b=0; b<nvirt; b++) Kij_a[b] += Bi_P[a] * Bj_P[b];
+		}
+	}
+#endif
+}
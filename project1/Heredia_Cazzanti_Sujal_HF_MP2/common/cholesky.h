@@ -0,0 +1,22 @@
+#ifndef CHOLESKY_H
+#define CHOLESKY_H
+
+#include "integrals.h"
+
+///////////////////////////////////// CHOLESKY-DECOMPOSED MP2 INTEGRALS //////////////////////////
+//The (ia|jb) integrals form a symmetric positive semidefinite (o*v) x (o*v) matrix M[ia][jb]. A pivoted Cholesky
+//decomposition stops once the largest diagonal element of the residual M - sum_P L_P L_P^T is below the threshold:
+//since the residual is semidefinite, that diagonal element bounds every residual element. The naux vectors
+//L_P[ia] = B_i[P][a] need o*v*naux doubles, with naux usually a small multiple of o+v. They are built from the full
+//store, which is only freed afterwards: the factorization lowers the memory held by the MP2 loop, not the peak.
+
+//Factorizes the blocks of 'K' into 'factors'. The residual diagonal is taken from 'arena' and the vectors being built
+//from the heap, declared to it. Once they are built the arena is released down to 'release', which frees 'K' if it
+//lies above (arena_mark(arena) keeps it), and the factors are taken from the arena.
+void cholesky_decompose(const ovov_blocks_t* K, double threshold, arena_t* arena, size_t release,
+                        ovov_factors_t* factors);
+
+//Rebuilds K_ij[a][b] = sum_P B_i[P][a] B_j[P][b] into 'Kij' (nvirt*nvirt doubles): a DGEMM with -DUSE_CBLAS
+void cholesky_block(const ovov_factors_t* factors, int i, int j, double* Kij);
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "eri_cache.h"
+#include "report.h"
+
+#define ERI_CACHE_MAGIC "TRXERI\0\0"
+
+//The header takes 64 bytes so that the table behind it stays aligned to a cache line
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;    //sizeof(eri_kv_t), guards against a different layout
+	uint64_t source_hash;   //Hash of the TREXIO file the table was built from
+	int64_t n;              //Number of (key,value) pairs
+	uint64_t endian_check;  //Written as 1, reads differently on a machine with another byte order
+	char padding[24];
+} eri_cache_header_t;
+
+static char* sidecar_path(const char* source){
+	char* path = malloc(strlen(source) + strlen(ERI_CACHE_SUFFIX) + 1);
+	if ( path == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+	strcpy(path, source);
+	strcat(path, ERI_CACHE_SUFFIX);
+	return path;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t bytes){
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t m=0; m<bytes; m++){
+		hash ^= p[m];
+		hash *= 1099511628211ULL; //FNV prime
+	}
+	return hash;
+}
+
+uint64_t eri_cache_hash_file(const char* path){
+	int fd = open(path, O_RDONLY);
+	if ( fd < 0 ) return 0;
+	struct stat st;
+	if ( fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ){
+		close(fd);
+		return 0;
+	}
+
+	//Any rewrite of the file changes its modification time or its size, a replacement its inode
+	uint64_t identity[6] = { (uint64_t)st.st_dev, (uint64_t)st.st_ino, (uint64_t)st.st_size,
+	                         (uint64_t)st.st_mtim.tv_sec, (uint64_t)st.st_mtim.tv_nsec, ERI_CACHE_HASH_BYTES };
+	uint64_t hash = fnv1a(14695981039346656037ULL, identity, sizeof(identity)); //From the FNV offset basis
+
+	unsigned char head[ERI_CACHE_HASH_BYTES];
+	ssize_t got = read(fd, head, sizeof(head));
+	close(fd);
+	if ( got < 0 ) return 0;
+	hash = fnv1a(hash, head, (size_t)got);
+	return ( hash != 0 ) ? hash : 1; //0 means no hash
+}
+
+int eri_cache_load(const char* source, uint64_t source_hash, eri_table_t* table){
+	char* path = sidecar_path(source);
+	int fd = open(path, O_RDONLY);
+	free(path);
+	if ( fd < 0 ) return 0;
+
+	struct stat st;
+	if ( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(eri_cache_header_t) ){
+		close(fd);
+		return 0;
+	}
+
+	void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //The mapping stays valid after closing the descriptor
+	if ( map == MAP_FAILED ) return 0;
+
+	const eri_cache_header_t* header = (const eri_cache_header_t*)map;
+	int valid = memcmp(header->magic, ERI_CACHE_MAGIC, 8) == 0
+	         && header->version == ERI_CACHE_VERSION
+	         && header->entry_size == sizeof(eri_kv_t)
+	         && header->endian_check == 1
+	         && header->source_hash == source_hash
+	         && header->n >= 0
+	         && (size_t)st.st_size == sizeof(eri_cache_header_t) + (size_t)header->n*sizeof(eri_kv_t);
+	if ( !valid ){
+		munmap(map, (size_t)st.st_size);
+		return 0;
+	}
+
+	madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL); //Consumers walk the table front to back
+	table->kv = (eri_kv_t*)((char*)map + sizeof(eri_cache_header_t));
+	table->n = header->n;
+	table->mapping = map;
+	table->mapping_size = (size_t)st.st_size;
+	table->in_arena = 0;
+	return 1;
+}
+
+int eri_cache_store(const char* source, uint64_t source_hash, const eri_table_t* table){
+	char* path = sidecar_path(source);
+	char* tmp_path = malloc(strlen(path) + 32);
+	if ( tmp_path == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+	sprintf(tmp_path, "%s.tmp%ld", path, (long)getpid());
+
+	eri_cache_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ERI_CACHE_MAGIC, 8);
+	header.version = ERI_CACHE_VERSION;
+	header.entry_size = sizeof(eri_kv_t);
+	header.source_hash = source_hash;
+	header.n = table->n;
+	header.endian_check = 1;
+
+	int ok = 0;
+	FILE* f = fopen(tmp_path, "wb");
+	if ( f != NULL ){
+		ok = fwrite(&header, sizeof(header), 1, f) == 1
+		  && fwrite(table->kv, sizeof(eri_kv_t), (size_t)table->n, f) == (size_t)table->n;
+		ok = (fflush(f) == 0) && ok;
+		ok = (fsync(fileno(f)) == 0) && ok; //On disk before it replaces the previous sidecar
+		ok = (fclose(f) == 0) && ok;
+		if ( ok ) ok = rename(tmp_path, path) == 0;
+		if ( !ok ) remove(tmp_path);
+	}
+
+	free(path);
+	free(tmp_path);
+	return ok;
+}
+
+trexio_exit_code eri_cache_table(trexio_t* file, const char* source, uint64_t hash, int64_t chunk, arena_t* arena,
+                                 eri_table_t* table){
+
+	if ( hash != 0 && eri_cache_load(source, hash, table) ){
+		printf("ERI cache: %ld integrals mapped from %s%s \n", (long)table->n, source, ERI_CACHE_SUFFIX);
+		REPORT_COUNT(integrals_read, table->n);
+		return TREXIO_SUCCESS;
+	}
+
+	trexio_exit_code rc = eri_table_build(file, chunk, arena, table);
+	if ( rc != TREXIO_SUCCESS ) return rc;
+
+	if ( hash != 0 && eri_cache_store(source, hash, table) ){
+		printf("ERI cache: %ld integrals written to %s%s \n", (long)table->n, source, ERI_CACHE_SUFFIX);
+	}
+	else{
+		printf("ERI cache: could not write %s%s, continuing without it \n", source, ERI_CACHE_SUFFIX);
+	}
+	return TREXIO_SUCCESS;
+}
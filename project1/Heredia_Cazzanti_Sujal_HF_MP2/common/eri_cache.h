@@ -0,0 +1,39 @@
+#ifndef ERI_CACHE_H
+#define ERI_CACHE_H
+
+#include <stdint.h>
+#include <trexio.h>
+#include "eri_table.h"
+
+///////////////////////////////////// PERSISTENT ERI CACHE //////////////////////////
+//The canonical sorted ERI table of a TREXIO file is written, on first use, to a binary sidecar file next to it
+//('<file>.eri'). The sidecar starts with a header (magic, format version, hash of the source file, number of
+//integrals) followed by the raw eri_kv_t array. Later runs map it read-only: the table is used in place, with
+//no TREXIO read, no canonicalization and no sort. If the source file changed (different hash) or the format
+//version does not match, the sidecar is ignored and rebuilt.
+//The hash identifies the file without reading it all, so that a run on a cached file starts in constant time: it
+//covers the device, inode, size and modification time of the file, and its first ERI_CACHE_HASH_BYTES bytes.
+
+#define ERI_CACHE_VERSION 2
+#define ERI_CACHE_SUFFIX ".eri"
+#define ERI_CACHE_HASH_BYTES 4096
+
+//64-bit FNV-1a hash of the identity of 'path' (see above). Returns 0, which disables the cache, if 'path' is not a
+//regular file (e.g. a directory of the TREXIO text back end) or cannot be read.
+uint64_t eri_cache_hash_file(const char* path);
+
+//Maps the sidecar of 'source' into 'table' if it exists and matches 'source_hash'. Returns 1 on success,
+//0 otherwise. The mapping is released by eri_table_free.
+int eri_cache_load(const char* source, uint64_t source_hash, eri_table_t* table);
+
+//Writes 'table' as the sidecar of 'source' (through a temporary file synced and renamed at the end, so neither a
+//concurrent reader nor a crash leaves a half-written cache). Returns 1 on success, 0 otherwise.
+int eri_cache_store(const char* source, uint64_t source_hash, const eri_table_t* table);
+
+//Gets the canonical table of 'source', whose hash is 'source_hash' (from eri_cache_hash_file, 0 disables the cache):
+//mapped from its sidecar when it is valid, otherwise built from the already opened 'file' (see eri_table_build,
+//'arena' included) and stored as the new sidecar.
+trexio_exit_code eri_cache_table(trexio_t* file, const char* source, uint64_t source_hash, int64_t chunk,
+                                 arena_t* arena, eri_table_t* table);
+
+#endif
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "eri_stream.h"
+#include "report.h"
+
+static pthread_mutex_t trexio_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void eri_stream_lock(void){
+	pthread_mutex_lock(&trexio_mutex);
+}
+
+void eri_stream_unlock(void){
+	pthread_mutex_unlock(&trexio_mutex);
+}
+
+size_t eri_stream_parse_mem_limit(const char* text){
+	char* end;
+	unsigned long long value = strtoull(text, &end, 10);
+	if (end == text) return 0;
+
+	switch (toupper((unsigned char)*end)){
+		case '\0':                  break;
+		case 'K': value <<= 10; end++; break;
+		case 'M': value <<= 20; end++; break;
+		case 'G': value <<= 30; end++; break;
+		default: return 0;
+	}
+	if (*end == 'B' || *end == 'b') end++; //Accept "512MB" as well as "512M"
+	if (*end != '\0') return 0;
+
+	return (size_t)value;
+}
+
+int64_t eri_stream_chunk_size(size_t mem_limit){
+	int64_t chunk = (int64_t)(mem_limit / (ERI_STREAM_ENTRY_BYTES*ERI_STREAM_BUFFERS));
+	return (chunk > 0) ? chunk : 1;
+}
+
+size_t eri_stream_arena_bytes(int64_t integrals, int64_t chunk){
+	if ( chunk > integrals ) chunk = (integrals > 0) ? integrals : 1; //As eri_stream_read
+	int nbuffers = ( integrals > chunk ) ? ERI_STREAM_BUFFERS : 1;
+	return nbuffers*( arena_round((size_t)chunk*4*sizeof(int32_t)) + arena_round((size_t)chunk*4*sizeof(uint16_t)) +
+	                  arena_round((size_t)chunk*sizeof(double)) );
+}
+
+int eri_index_width(const int32_t* indexes, int64_t n){
+	uint32_t all = 0; //OR of the indexes: its highest bit is that of the largest one
+	for (int64_t k=0; k<4*n; k++) all |= (uint32_t)indexes[k];
+	if ( all < 256 ) return 1;
+	if ( all < 65536 ) return 2;
+	return 4;
+}
+
+void eri_narrow_indexes(const int32_t* indexes, int64_t n, int width, void* out){
+	if ( width == 1 ){
+		uint8_t* out8 = (uint8_t*)out;
+		for (int64_t k=0; k<4*n; k++) out8[k] = (uint8_t)indexes[k];
+	}
+	else{
+		uint16_t* out16 = (uint16_t*)out;
+		for (int64_t k=0; k<4*n; k++) out16[k] = (uint16_t)indexes[k];
+	}
+}
+
+///////////////////////////////////// PREFETCH //////////////////////////
+//One buffer of the ring: a chunk as read from the file and its narrowed indexes
+typedef struct {
+	int32_t* indexes;
+	uint16_t* compact;   //Narrowed copy of 'indexes'
+	double* values;
+	eri_chunk_t piece;   //What the consumer gets
+	int full;            //Holds a chunk not consumed yet
+} eri_buffer_t;
+
+//Ring of ERI_STREAM_BUFFERS buffers shared by the reader thread and the consumer: the reader fills buffer k%B while
+//the consumer works on the previous ones, and waits when all of them are full (back-pressure)
+typedef struct {
+	trexio_t* file;
+	int64_t integrals;   //In the file
+	int64_t chunk;       //Integrals per buffer
+	eri_buffer_t buffer[ERI_STREAM_BUFFERS];
+	int64_t produced;    //Chunks filled by the reader so far
+	int finished;        //The reader is done, 'rc' is its status
+	trexio_exit_code rc;
+	report_t* report;    //Report of the consumer thread, which the reader also fills
+	pthread_mutex_t lock;
+	pthread_cond_t changed; //A buffer was filled or emptied, or the reader finished
+} eri_prefetch_t;
+
+//Reads the chunk at 'offset' into 'b' and narrows its indexes. Returns the TREXIO status, TREXIO_END at the end of
+//the file. 'background' is set on the reader thread, whose read time overlaps the consumer phases.
+static trexio_exit_code read_chunk(trexio_t* file, int64_t offset, int64_t chunk, eri_buffer_t* b, int background){
+	int64_t read = chunk; //On return, number of integrals actually read
+	double t_read = report_time();
+	eri_stream_lock();
+	trexio_exit_code rc = trexio_read_mo_2e_int_eri(file, offset, &read, b->indexes, b->values);
+	eri_stream_unlock();
+	double elapsed = report_time() - t_read;
+	REPORT_COUNT(seconds[REPORT_ERI_READ], elapsed);
+	if ( background ) REPORT_COUNT(eri_read_background, elapsed);
+	if ( rc != TREXIO_SUCCESS && rc != TREXIO_END ) return rc;
+
+	REPORT_COUNT(integrals_read, read);
+	eri_chunk_t piece = { read, eri_index_width(b->indexes, read), b->indexes, b->values };
+	if ( piece.width < 4 ){
+		eri_narrow_indexes(b->indexes, read, piece.width, b->compact);
+		piece.indexes = b->compact;
+	}
+	b->piece = piece;
+	return rc;
+}
+
+static void* prefetch_reader(void* arg){
+	eri_prefetch_t* pf = (eri_prefetch_t*)arg;
+	report_set_current(pf->report);
+	trexio_exit_code rc = TREXIO_SUCCESS;
+
+	for (int64_t offset=0, k=0; offset<pf->integrals; k++){
+		eri_buffer_t* b = &pf->buffer[k % ERI_STREAM_BUFFERS];
+		pthread_mutex_lock(&pf->lock);
+		while ( b->full ) pthread_cond_wait(&pf->changed, &pf->lock); //Back-pressure: the consumer is behind
+		pthread_mutex_unlock(&pf->lock);
+
+		rc = read_chunk(pf->file, offset, pf->chunk, b, 1);
+		if ( rc != TREXIO_SUCCESS && rc != TREXIO_END ) break;
+
+		pthread_mutex_lock(&pf->lock);
+		b->full = 1;
+		pf->produced++;
+		pthread_cond_broadcast(&pf->changed);
+		pthread_mutex_unlock(&pf->lock);
+
+		offset += b->piece.n;
+		if ( rc == TREXIO_END || b->piece.n == 0 ) break;
+	}
+
+	pthread_mutex_lock(&pf->lock);
+	pf->finished = 1;
+	pf->rc = rc;
+	pthread_cond_broadcast(&pf->changed);
+	pthread_mutex_unlock(&pf->lock);
+	return NULL;
+}
+
+trexio_exit_code eri_stream_read(trexio_t* file, int64_t chunk, arena_t* arena, eri_chunk_fn consume, void* ctx){
+	trexio_exit_code rc;
+	int64_t integrals; //Total number of integrals in the file
+
+	double t0 = report_time();
+	eri_stream_lock();
+	rc = trexio_read_mo_2e_int_eri_size(file, &integrals);
+	eri_stream_unlock();
+	REPORT_TIME(REPORT_ERI_SIZE, t0);
+	if ( rc != TREXIO_SUCCESS) return rc;
+	if ( chunk > integrals ) chunk = (integrals > 0) ? integrals : 1; //No need for a buffer larger than the file
+
+	//Only the chunks of the ring live in memory at any time
+	eri_prefetch_t pf;
+	memset(&pf, 0, sizeof(pf));
+	pf.file = file;
+	pf.integrals = integrals;
+	pf.chunk = chunk;
+	pf.report = report_current();
+	int nbuffers = ( integrals > chunk ) ? ERI_STREAM_BUFFERS : 1; //A single chunk leaves nothing to overlap
+	size_t mark = ( arena != NULL ) ? arena_mark(arena) : 0;
+	for (int k=0; k<nbuffers; k++){
+		eri_buffer_t* b = &pf.buffer[k];
+		if ( arena != NULL ){
+			b->indexes = arena_alloc(arena, (size_t)chunk*4*sizeof(int32_t));
+			b->compact = arena_alloc(arena, (size_t)chunk*4*sizeof(uint16_t));
+			b->values = arena_alloc(arena, (size_t)chunk*sizeof(double));
+			continue;
+		}
+		b->indexes = malloc((size_t)chunk*4*sizeof(int32_t));
+		b->compact = malloc((size_t)chunk*4*sizeof(uint16_t));
+		b->values = malloc((size_t)chunk*sizeof(double));
+		if ( b->indexes == NULL || b->compact == NULL || b->values == NULL ){
+			printf("Memory allocation went wrong");
+			exit(1);
+		}
+	}
+
+	if ( nbuffers == 1 ){
+		for (int64_t offset=0; offset<integrals; ){
+			rc = read_chunk(file, offset, chunk, &pf.buffer[0], 0);
+			if ( rc != TREXIO_SUCCESS && rc != TREXIO_END ) break;
+			consume(&pf.buffer[0].piece, ctx);
+			offset += pf.buffer[0].piece.n;
+			if ( rc == TREXIO_END || pf.buffer[0].piece.n == 0 ) break;
+		}
+	}
+	else{
+		pthread_mutex_init(&pf.lock, NULL);
+		pthread_cond_init(&pf.changed, NULL);
+		pthread_t reader;
+		if ( pthread_create(&reader, NULL, prefetch_reader, &pf) != 0 ){
+			printf("Cannot start the reader thread\n");
+			exit(1);
+		}
+
+		//Chunks in file order, each consumed while the reader fills the next ones
+		for (int64_t k=0; ; k++){
+			eri_buffer_t* b = &pf.buffer[k % ERI_STREAM_BUFFERS];
+			double t_wait = report_time();
+			pthread_mutex_lock(&pf.lock);
+			while ( !b->full && !(pf.finished && k >= pf.produced) ) pthread_cond_wait(&pf.changed, &pf.lock);
+			int ready = b->full;
+			pthread_mutex_unlock(&pf.lock);
+			REPORT_COUNT(eri_wait, report_time() - t_wait);
+			if ( !ready ) break;
+
+			consume(&b->piece, ctx);
+
+			pthread_mutex_lock(&pf.lock);
+			b->full = 0;
+			pthread_cond_broadcast(&pf.changed);
+			pthread_mutex_unlock(&pf.lock);
+		}
+		pthread_join(reader, NULL);
+		rc = pf.rc;
+		pthread_mutex_destroy(&pf.lock);
+		pthread_cond_destroy(&pf.changed);
+	}
+	if ( rc == TREXIO_END ) rc = TREXIO_SUCCESS; //Reaching the end of the file is the normal way out
+
+	//The raw chunks are not needed once consumed
+	if ( arena != NULL ) arena_release(arena, mark);
+	else{
+		for (int k=0; k<nbuffers; k++){
+			free(pf.buffer[k].indexes);
+			pf.buffer[k].indexes=NULL;
+			free(pf.buffer[k].compact);
+			pf.buffer[k].compact=NULL;
+			free(pf.buffer[k].values);
+			pf.buffer[k].values=NULL;
+		}
+	}
+	return rc;
+}
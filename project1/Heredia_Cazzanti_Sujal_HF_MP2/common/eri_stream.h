@@ -0,0 +1,74 @@
+#ifndef ERI_STREAM_H
+#define ERI_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <trexio.h>
+#include "arena.h"
+
+///////////////////////////////////// CHUNKED ERI READER //////////////////////////
+//TREXIO lets us read the sparse two-electron integrals in pieces: trexio_read_mo_2e_int_eri takes an offset
+//in the file and a buffer size. Instead of allocating 'integrals' entries at once, we allocate a ring of
+//ERI_STREAM_BUFFERS buffers whose size is fixed by a memory budget and hand each chunk to a consumer (HF
+//accumulator, MP2 block builder, table canonicalization). Peak memory then depends on the budget and not on the
+//number of integrals stored in the file.
+//A reader thread fills the next buffers (reading and decompressing through HDF5, then narrowing the indexes) while
+//the calling thread consumes the current one, and waits when the ring is full. The wall time of the stream is
+//then close to the larger of the read and consume times rather than their sum.
+
+#define ERI_STREAM_DEFAULT_MEM_LIMIT ((size_t)64 << 20) //Default buffer budget: 64 MiB
+#ifndef ERI_STREAM_BUFFERS
+#define ERI_STREAM_BUFFERS 2 //Chunks in flight: 2 is double buffering
+#endif
+//Memory taken by one buffered integral: TREXIO indexes, their compact copy and the value
+#define ERI_STREAM_ENTRY_BYTES (4*sizeof(int32_t) + 4*sizeof(uint16_t) + sizeof(double))
+
+//TREXIO (through HDF5) is not guaranteed to be thread-safe. Every TREXIO call of the shared code is made while
+//holding this process-wide lock, so different threads can work on different files: one of them reads while the
+//others compute. The consumers are called without the lock.
+void eri_stream_lock(void);
+void eri_stream_unlock(void);
+
+//One chunk of integrals. TREXIO hands out 4 int32 indexes per integral, far wider than the number of orbitals of
+//our molecules (below 256 for all of them): each chunk is narrowed, right after it is read, to the smallest index
+//width that holds all its indexes, so the consumers stream 12 bytes per integral instead of 24.
+typedef struct {
+	int64_t n;            //Number of integrals
+	int width;            //Bytes per index: 1 (uint8_t), 2 (uint16_t) or 4 (int32_t)
+	const void* indexes;  //4 indexes per integral, of the type given by 'width'
+	const double* values; //The corresponding <pq|rs>
+} eri_chunk_t;
+
+//Index number 'pos' (0..3) of integral 'm'
+static inline int eri_chunk_index(const eri_chunk_t* chunk, int64_t m, int pos){
+	switch ( chunk->width ){
+		case 1: return ((const uint8_t*)chunk->indexes)[4*m + pos];
+		case 2: return ((const uint16_t*)chunk->indexes)[4*m + pos];
+		default: return ((const int32_t*)chunk->indexes)[4*m + pos];
+	}
+}
+
+//Smallest index width (1, 2 or 4 bytes) holding all the 4*n indexes
+int eri_index_width(const int32_t* indexes, int64_t n);
+
+//Copies the 4*n indexes into 'out' with 'width' bytes each (1 or 2)
+void eri_narrow_indexes(const int32_t* indexes, int64_t n, int width, void* out);
+
+//Consumer of one chunk
+typedef void (*eri_chunk_fn)(const eri_chunk_t* chunk, void* ctx);
+
+//Converts a size such as "512M", "2G", "64k" or "1000000" (bytes) into bytes. Returns 0 if not valid.
+size_t eri_stream_parse_mem_limit(const char* text);
+
+//Number of integrals per chunk such that the ERI_STREAM_BUFFERS buffers fit in 'mem_limit' bytes (at least 1)
+int64_t eri_stream_chunk_size(size_t mem_limit);
+
+//Arena bytes eri_stream_read takes for a file of 'integrals' integrals read 'chunk' at a time
+size_t eri_stream_arena_bytes(int64_t integrals, int64_t chunk);
+
+//Reads all the 2-electron integrals of 'file', 'chunk' at a time, calling 'consume' on each chunk in file order
+//from the calling thread. The buffers of the ring are taken from 'arena' (NULL: from the heap) and released before
+//returning. Returns TREXIO_SUCCESS or the first TREXIO error met (the chunks before it are consumed).
+trexio_exit_code eri_stream_read(trexio_t* file, int64_t chunk, arena_t* arena, eri_chunk_fn consume, void* ctx);
+
+#endif
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "eri_table.h"
+#include "report.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+///////////////////////////////////// INGEST //////////////////////////
+typedef struct {
+	eri_table_t* table; //Table being filled
+	int64_t capacity;   //Number of integrals announced by the file
+} eri_table_fill_t;
+
+//Canonicalizes 'n' integrals whose indexes are of type 'index_t' (one loop per index width, each vectorizable)
+#define CANONICALIZE(index_t, indexes, values, n, out) do { \
+	const index_t* idx_ = (const index_t*)(indexes); \
+	_Pragma("omp parallel for schedule(static)") \
+	for (int64_t m=0; m<(n); m++){ \
+		(out)[m].key = canonical_key_8fold(idx_[4*m + 0], idx_[4*m + 1], idx_[4*m + 2], idx_[4*m + 3]); \
+		(out)[m].val = (values)[m]; \
+	} \
+} while (0)
+
+//Chunk consumer: canonicalizes the chunk into the next free slots of the table
+static void eri_table_append(const eri_chunk_t* chunk, void* ctx){
+	eri_table_fill_t* fill = (eri_table_fill_t*)ctx;
+	int64_t n = chunk->n;
+	if ( fill->table->n + n > fill->capacity ){
+		printf("The file holds more 2-electron integrals than announced\n");
+		exit(1);
+	}
+	eri_kv_t* out = fill->table->kv + fill->table->n;
+	double t0 = report_time();
+
+	switch ( chunk->width ){
+		case 1: CANONICALIZE(uint8_t, chunk->indexes, chunk->values, n, out); break;
+		case 2: CANONICALIZE(uint16_t, chunk->indexes, chunk->values, n, out); break;
+		default: CANONICALIZE(int32_t, chunk->indexes, chunk->values, n, out); break;
+	}
+	fill->table->n += n;
+	REPORT_TIME(REPORT_CANONICALIZE, t0);
+}
+
+trexio_exit_code eri_table_build(trexio_t* file, int64_t chunk, arena_t* arena, eri_table_t* table){
+	trexio_exit_code rc;
+	int64_t integrals;
+	double t0 = report_time();
+
+	eri_stream_lock();
+	rc = trexio_read_mo_2e_int_eri_size(file, &integrals);
+	eri_stream_unlock();
+	REPORT_TIME(REPORT_ERI_SIZE, t0);
+	if ( rc != TREXIO_SUCCESS) return rc;
+
+	table->n = 0;
+	table->mapping = NULL;
+	table->mapping_size = 0;
+	table->in_arena = ( arena != NULL );
+	if ( arena != NULL ) table->kv = arena_alloc(arena, (size_t)integrals*sizeof(eri_kv_t));
+	else table->kv = malloc((size_t)(integrals > 0 ? integrals : 1)*sizeof(eri_kv_t));
+	if ( table->kv == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+
+	eri_table_fill_t fill = { table, integrals };
+	rc = eri_stream_read(file, chunk, arena, eri_table_append, &fill);
+	if ( rc != TREXIO_SUCCESS) return rc;
+	double t1 = report_time();
+
+	size_t mark = ( arena != NULL ) ? arena_mark(arena) : 0;
+	eri_kv_t* tmp;
+	if ( arena != NULL ) tmp = arena_alloc(arena, (size_t)table->n*sizeof(eri_kv_t));
+	else tmp = malloc((size_t)(table->n > 0 ? table->n : 1)*sizeof(eri_kv_t));
+	if ( tmp == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+	eri_radix_sort(table->kv, tmp, table->n, arena);
+	if ( arena != NULL ) arena_release(arena, mark);
+	else free(tmp);
+	tmp=NULL;
+	double t2 = report_time();
+	REPORT_TIME(REPORT_SORT, t1);
+
+	printf("ERI table: %ld integrals, read+canonicalize %f s, sort %f s (%.3e integrals/s) \n",
+	       (long)table->n, t1-t0, t2-t1, (t2 > t0) ? table->n/(t2-t0) : 0.0);
+	return TREXIO_SUCCESS;
+}
+
+//Per-thread histograms of the radix sort
+static size_t radix_offsets_bytes(void){
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	return (size_t)nthreads*RADIX_BUCKETS*sizeof(int64_t);
+}
+
+//Chunk buffers of eri_table_stream: 16-bit indexes and values
+static size_t table_stream_bytes(int64_t n, int64_t chunk){
+	if ( chunk > n ) chunk = (n > 0) ? n : 1;
+	return arena_round((size_t)chunk*4*sizeof(uint16_t)) + arena_round((size_t)chunk*sizeof(double));
+}
+
+size_t eri_table_arena_bytes(int64_t integrals, int64_t chunk){
+	//The table stays, the read buffers, the scratch of the sort and the chunk buffers of eri_table_stream come after
+	//it in turn
+	size_t table = arena_round((size_t)integrals*sizeof(eri_kv_t));
+	size_t stream = eri_stream_arena_bytes(integrals, chunk);
+	size_t sort = table + arena_round(radix_offsets_bytes());
+	size_t out = table_stream_bytes(integrals, chunk);
+	size_t scratch = (stream > sort) ? stream : sort;
+	return table + ( (out > scratch) ? out : scratch );
+}
+
+///////////////////////////////////// PARALLEL LSD RADIX SORT //////////////////////////
+//One pass per byte of the key, least significant first. In each pass every thread histograms its own slice,
+//the per-thread histograms are turned into scatter offsets (bucket-major, then thread order, which keeps the
+//sort stable) and every thread scatters its slice. Passes whose byte is the same for all keys are skipped:
+//with 16 bits per index and mo < 256 half of the passes disappear.
+void eri_radix_sort(eri_kv_t* kv, eri_kv_t* tmp, int64_t n, arena_t* arena){
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	size_t mark = ( arena != NULL ) ? arena_mark(arena) : 0;
+	size_t bytes = (size_t)nthreads*RADIX_BUCKETS*sizeof(int64_t); //As radix_offsets_bytes
+	int64_t* offsets;
+	if ( arena != NULL ) offsets = arena_alloc(arena, bytes);
+	else offsets = malloc(bytes);
+	if ( offsets == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+
+	eri_kv_t* src = kv;
+	eri_kv_t* dst = tmp;
+
+	for (int shift=0; shift<64; shift+=RADIX_BITS){
+		int skip = 0;
+
+		#pragma omp parallel num_threads(nthreads)
+		{
+			int t = 0, nt = 1;
+#ifdef _OPENMP
+			t = omp_get_thread_num();
+			nt = omp_get_num_threads();
+#endif
+			int64_t lo = n*t/nt, hi = n*(t+1)/nt;
+			int64_t* count = offsets + (int64_t)t*RADIX_BUCKETS;
+
+			memset(count, 0, RADIX_BUCKETS*sizeof(int64_t));
+			for (int64_t m=lo; m<hi; m++){
+				count[(src[m].key >> shift) & (RADIX_BUCKETS-1)]++;
+			}
+
+			#pragma omp barrier
+			#pragma omp single
+			{
+				int64_t running = 0;
+				for (int b=0; b<RADIX_BUCKETS; b++){
+					int64_t total = 0;
+					for (int u=0; u<nt; u++){
+						int64_t c = offsets[(int64_t)u*RADIX_BUCKETS + b];
+						offsets[(int64_t)u*RADIX_BUCKETS + b] = running;
+						running += c;
+						total += c;
+					}
+					if ( total == n ) skip = 1; //Every key has the same byte here
+				}
+			}
+			//Implicit barrier at the end of 'single'
+
+			if ( !skip ){
+				for (int64_t m=lo; m<hi; m++){
+					dst[count[(src[m].key >> shift) & (RADIX_BUCKETS-1)]++] = src[m];
+				}
+			}
+		}
+
+		if ( !skip ){
+			eri_kv_t* swap = src;
+			src = dst;
+			dst = swap;
+		}
+	}
+
+	//An odd number of effective passes leaves the result in the scratch array
+	if ( src != kv ) memcpy(kv, src, (size_t)n*sizeof(eri_kv_t));
+
+	if ( arena != NULL ) arena_release(arena, mark);
+	else free(offsets);
+	offsets=NULL;
+}
+
+///////////////////////////////////// CONSUMERS //////////////////////////
+void eri_table_stream(const eri_table_t* table, int64_t chunk, arena_t* arena, eri_chunk_fn consume, void* ctx){
+	if ( chunk > table->n ) chunk = (table->n > 0) ? table->n : 1;
+
+	size_t mark = ( arena != NULL ) ? arena_mark(arena) : 0;
+	uint16_t* indexes; //Keys hold 16-bit indexes
+	double* values;
+	if ( arena != NULL ){
+		indexes = arena_alloc(arena, (size_t)chunk*4*sizeof(uint16_t));
+		values = arena_alloc(arena, (size_t)chunk*sizeof(double));
+	}
+	else{
+		indexes = malloc((size_t)chunk*4*sizeof(uint16_t));
+		values = malloc((size_t)chunk*sizeof(double));
+	}
+	if ( indexes == NULL || values == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+
+	for (int64_t offset=0; offset<table->n; offset+=chunk){
+		int64_t n = (table->n - offset < chunk) ? table->n - offset : chunk;
+		const eri_kv_t* kv = table->kv + offset;
+
+		//Indexes below 256 leave the high byte of every 16-bit field of the keys empty
+		uint64_t all = 0;
+		for (int64_t m=0; m<n; m++) all |= kv[m].key;
+		eri_chunk_t piece = { n, ( (all & 0xFF00FF00FF00FF00ULL) == 0 ) ? 1 : 2, indexes, values };
+
+		for (int64_t m=0; m<n; m++){
+			for (int pos=0; pos<4; pos++){
+				if ( piece.width == 1 ) ((uint8_t*)indexes)[4*m + pos] = (uint8_t)key_index(kv[m].key, pos);
+				else indexes[4*m + pos] = (uint16_t)key_index(kv[m].key, pos);
+			}
+			values[m] = kv[m].val;
+		}
+		consume(&piece, ctx);
+	}
+
+	if ( arena != NULL ) arena_release(arena, mark);
+	else{
+		free(indexes);
+		free(values);
+	}
+	indexes=NULL;
+	values=NULL;
+}
+
+void eri_table_free(eri_table_t* table){
+	if ( table->mapping != NULL ){
+		munmap(table->mapping, table->mapping_size);
+		table->mapping=NULL;
+		table->mapping_size=0;
+	}
+	else if ( !table->in_arena ){
+		free(table->kv);
+	}
+	table->kv=NULL;
+	table->n=0;
+}
@@ -0,0 +1,78 @@
+#ifndef ERI_TABLE_H
+#define ERI_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <trexio.h>
+#include "eri_stream.h"
+#include "arena.h"
+
+///////////////////////////////////// CANONICAL ERI TABLE //////////////////////////
+//Two-electron integrals obey 8-fold permutational symmetry:
+//<ij|kl> = <il|kj> = <kl|ij> = <kj|il> = <ji|lk> = <li|jk> = <lk|ji> = <jk|li>
+//Each quartet is canonicalized by taking the lexicographically smallest of its 8 permutations, packed into a
+//64-bit key (16 bits per index, first index in the highest bits). Since the packing preserves the lexicographic
+//order, the smallest tuple is simply the smallest of the 8 packed keys, which needs no branches.
+//The table holds all the integrals of a file as (key,value) pairs sorted by key.
+
+typedef struct {
+	uint64_t key;
+	double val;
+} eri_kv_t;
+
+typedef struct {
+	eri_kv_t* kv;        //Sorted (key,value) pairs
+	int64_t n;           //Number of pairs
+	void* mapping;       //Non-NULL when 'kv' lives in a read-only mapped cache file (see eri_cache.h)
+	size_t mapping_size;
+	int in_arena;        //'kv' was taken from an arena, which releases it
+} eri_table_t;
+
+static inline uint64_t pack4_u16(uint16_t a, uint16_t b, uint16_t c, uint16_t d){
+	return ((uint64_t)a << 48) | ((uint64_t)b << 32) | ((uint64_t)c << 16) | (uint64_t)d;
+}
+
+static inline uint64_t min_u64(uint64_t x, uint64_t y){
+	return (x < y) ? x : y; //Compiles to a conditional move
+}
+
+static inline uint64_t canonical_key_8fold(int p, int q, int r, int s){
+	uint64_t k = pack4_u16(p,q,r,s);             // <pq|rs>
+	k = min_u64(k, pack4_u16(p,s,r,q));          // <ps|rq>
+	k = min_u64(k, pack4_u16(r,s,p,q));          // <rs|pq>
+	k = min_u64(k, pack4_u16(r,q,p,s));          // <rq|ps>
+	k = min_u64(k, pack4_u16(q,p,s,r));          // <qp|sr>
+	k = min_u64(k, pack4_u16(s,p,q,r));          // <sp|qr>
+	k = min_u64(k, pack4_u16(s,r,q,p));          // <sr|qp>
+	k = min_u64(k, pack4_u16(q,r,s,p));          // <qr|sp>
+	return k;
+}
+
+//Index number 'pos' (0..3) of a packed key
+static inline int key_index(uint64_t key, int pos){
+	return (int)((key >> (48 - 16*pos)) & 0xFFFF);
+}
+
+//Reads all the integrals of 'file' ('chunk' at a time), canonicalizes them in parallel and sorts them with a
+//multi-threaded LSD radix sort. Prints the ingest throughput. Returns TREXIO_SUCCESS or the TREXIO error met.
+//With an 'arena' (NULL: the heap) the table is taken from it, and the read buffers and the scratch of the sort are
+//released as soon as they are done with.
+trexio_exit_code eri_table_build(trexio_t* file, int64_t chunk, arena_t* arena, eri_table_t* table);
+
+//Arena bytes eri_table_build takes for a file of 'integrals' integrals read 'chunk' at a time, the table included,
+//and then eri_table_stream of the table
+size_t eri_table_arena_bytes(int64_t integrals, int64_t chunk);
+
+//Sorts 'n' pairs by key. 'tmp' is a scratch array of the same size. The histograms are taken from 'arena' (NULL: the
+//heap) and released on return.
+void eri_radix_sort(eri_kv_t* kv, eri_kv_t* tmp, int64_t n, arena_t* arena);
+
+//Hands the table to a chunk consumer, 'chunk' integrals at a time, with the keys unpacked into 4 indexes. The chunk
+//buffers are taken from 'arena' (NULL: the heap) and released on return.
+void eri_table_stream(const eri_table_t* table, int64_t chunk, arena_t* arena, eri_chunk_fn consume, void* ctx);
+
+//Releases the table, either allocated by eri_table_build or mapped by eri_cache_load (a table in an arena goes with
+//the arena)
+void eri_table_free(eri_table_t* table);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fock.h"
+#include "eri_table.h"
+#include "report.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+int fock_parse_option(int argc, char** argv, int* k, integrals_options_t* opts){
+	(void)argc;
+	if ( strcmp(argv[*k], "--fock") == 0 ){
+		opts->want_fock = 1;
+		return 1;
+	}
+	return 0;
+}
+
+//Adds the 8 permutations of (ab|cd) = v to J and K. A permutation met several times among the 8 (a==b, c==d or
+//{a,b}=={c,d}) is met exactly 2, 4 or 8 times, which the weight of v undoes, so no permutation is tested.
+//D, J and K are symmetric, so the 8 permutations pair up into updates of (p,q) and (q,p) with the same value: only
+//one of each pair is added here, to X for J and to Y for K, and J = X + X^T, K = Y + Y^T once the table is done.
+//That is 6 updates per integral instead of 16.
+static inline void jk_scatter(double* X, double* Y, const double* D, int mo, int a, int b, int c, int d, double v){
+	if ( a == b ) v *= 0.5;
+	if ( c == d ) v *= 0.5;
+	if ( (a == c && b == d) || (a == d && b == c) ) v *= 0.5;
+
+	double d_ab = D[a*mo + b], d_cd = D[c*mo + d];
+	double d_ac = D[a*mo + c], d_ad = D[a*mo + d], d_bc = D[b*mo + c], d_bd = D[b*mo + d];
+	X[a*mo + b] += 2*d_cd*v; //(ab|cd) D_cd with (ab|dc) D_dc, and (ba|..) for J_ba
+	X[c*mo + d] += 2*d_ab*v;
+	Y[a*mo + c] += d_bd*v;   //(ab|cd) = (pr|qs) with p=a, q=c, and (cd|ab) for K_ca
+	Y[b*mo + c] += d_ad*v;
+	Y[a*mo + d] += d_bc*v;
+	Y[b*mo + d] += d_ac*v;
+}
+
+void fock_jk(const integrals_t* ints, const double* D, double tol, double* J, double* K){
+	const eri_table_t* eri = &ints->eri;
+	int mo = ints->mo;
+	size_t mm = (size_t)mo*mo;
+	double dmax = 0.0;
+	for (size_t pq=0; pq<mm; pq++) dmax = fmax(dmax, fabs(D[pq]));
+	double vmin = (dmax > 0.0) ? tol/dmax : HUGE_VAL; //Smallest integral that counts
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	double* buffers = integrals_alloc((size_t)nthreads*2*mm); //X then Y of each thread
+
+	#pragma omp parallel num_threads(nthreads)
+	{
+		int t = 0, nt = 1;
+#ifdef _OPENMP
+		t = omp_get_thread_num();
+		nt = omp_get_num_threads();
+#endif
+		double* Xt = buffers + (size_t)t*2*mm;
+		double* Yt = Xt + mm;
+
+		//Keys are <pq|rs> = (pr|qs)
+		#pragma omp for schedule(static)
+		for (int64_t m=0; m<eri->n; m++){
+			if ( fabs(eri->kv[m].val) < vmin ) continue;
+			uint64_t key = eri->kv[m].key;
+			jk_scatter(Xt, Yt, D, mo, key_index(key, 0), key_index(key, 2), key_index(key, 1), key_index(key, 3),
+			           eri->kv[m].val);
+		}
+		//Implicit barrier: every buffer is complete
+
+		//Tree reduction: in the round of 'step', thread t (a multiple of 2*step) adds the buffer of thread t+step,
+		//so nt buffers are summed in log2(nt) rounds by nt/2, nt/4, ... threads at once
+		for (int step=1; step<nt; step*=2){
+			if ( t % (2*step) == 0 && t + step < nt ){
+				const double* other = buffers + (size_t)(t + step)*2*mm;
+				for (size_t pq=0; pq<2*mm; pq++) Xt[pq] += other[pq];
+			}
+			#pragma omp barrier
+		}
+	}
+
+	const double* X = buffers;
+	const double* Y = buffers + mm;
+	for (int p=0; p<mo; p++){
+		for (int q=0; q<mo; q++){
+			J[p*mo + q] = X[p*mo + q] + X[q*mo + p];
+			K[p*mo + q] = Y[p*mo + q] + Y[q*mo + p];
+		}
+	}
+	free(buffers);
+	buffers=NULL;
+}
+
+void fock_density(const integrals_t* ints, double* D){
+	int mo = ints->mo;
+	memset(D, 0, (size_t)mo*mo*sizeof(double));
+	for (int i=0; i<ints->num_elec; i++) D[i*mo + i] = 2.0;
+}
+
+void fock_build(const integrals_t* ints, const double* D, double* F){
+	int mo = ints->mo;
+	size_t mm = (size_t)mo*mo;
+	double* J = integrals_alloc(mm);
+	double* K = integrals_alloc(mm);
+	double t0 = report_time();
+	fock_jk(ints, D, 0.0, J, K);
+	REPORT_TIME(REPORT_FOCK, t0);
+	for (size_t pq=0; pq<mm; pq++) F[pq] = ints->core_h[pq] + J[pq] - 0.5*K[pq];
+	free(J);
+	J=NULL;
+	free(K);
+	K=NULL;
+}
+
+double fock_energy(const integrals_t* ints, const double* D, const double* F){
+	int mo = ints->mo;
+	double energy = 0.0;
+	for (int p=0; p<mo; p++){
+		for (int q=0; q<mo; q++){
+			energy += D[p*mo + q] * ( ints->core_h[q*mo + p] + F[q*mo + p] );
+		}
+	}
+	return ints->Vnn + 0.5*energy;
+}
+
+void fock_check(const integrals_t* ints, const double* F, fock_check_t* check){
+	int mo = ints->mo;
+	int o = ints->num_elec;
+	check->diagonal = 0.0;
+	check->occ_virt = 0.0;
+	for (int p=0; p<mo; p++){
+		check->diagonal = fmax(check->diagonal, fabs(F[p*mo + p] - ints->mo_energy[p]));
+	}
+	for (int i=0; i<o; i++){
+		for (int a=o; a<mo; a++) check->occ_virt = fmax(check->occ_virt, fabs(F[i*mo + a]));
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef FOCK_H
+#define FOCK_H
+
+#include "integrals.h"
+
+///////////////////////////////////// FOCK MATRIX //////////////////////////
+//Closed-shell Fock matrix in the MO basis, F = h + J - K/2, with
+//J_pq = sum_rs (pq|rs) D_rs and K_pq = sum_rs (pr|qs) D_rs
+//for a symmetric density D (D_pq = 2 delta_pq over the occupied MOs for the orbitals of the file). J and K are
+//built from the canonical ERI table kept by the loader (--fock): every stored integral is scattered into all its
+//symmetry-equivalent contributions, each thread into its own J and K (half of them, symmetrized at the end), and
+//the thread buffers are summed pairwise in a tree. E(HF) = Vnn + 1/2 Tr[D(h+F)].
+//For canonical orbitals F is diagonal with F_pp = eps_p: the largest deviation checks the MO energies of the file.
+
+//If argv[*k] is --fock sets opts->want_fock, moves *k past it and returns 1. Returns 0 otherwise.
+int fock_parse_option(int argc, char** argv, int* k, integrals_options_t* opts);
+#define FOCK_OPTIONS_USAGE "[--fock]"
+
+//J and K (mo*mo each, row-major) of the density D, from the table of a context loaded with want_fock. Integrals
+//with |(pq|rs)| max|D| below 'tol' are skipped (0 keeps them all), which drops the small integrals from the J/K
+//builds of the small density changes of the SCF.
+void fock_jk(const integrals_t* ints, const double* D, double tol, double* J, double* K);
+
+//Closed-shell density of the occupied MOs of the file, mo*mo
+void fock_density(const integrals_t* ints, double* D);
+
+//F = h + J - K/2 of the density D, mo*mo
+void fock_build(const integrals_t* ints, const double* D, double* F);
+
+//Vnn + 1/2 Tr[D(h+F)]
+double fock_energy(const integrals_t* ints, const double* D, const double* F);
+
+typedef struct {
+	double diagonal;  //Largest |F_pp - eps_p|
+	double occ_virt;  //Largest |F_ia|, i occupied and a virtual (zero at convergence, Brillouin)
+} fock_check_t;
+
+//How far F is from the diagonal matrix of the MO energies of the file
+void fock_check(const integrals_t* ints, const double* F, fock_check_t* check);
+
+#endif
@@ -0,0 +1,37 @@
+#include "hf.h"
+
+//Compensated (Kahan) addition of x to *sum, *c carrying the low-order bits lost so far
+static inline void kahan_add(double* sum, double* c, double x){
+	double y = x - *c;
+	double t = *sum + y;
+	*c = (t - *sum) - y;
+	*sum = t;
+}
+
+void hf_energy(const integrals_t* ints, hf_energy_t* energy){
+	int o = ints->num_elec;
+	int mo = ints->mo;
+
+	//Contribution of the nuclear-nuclear repulsion (only once)
+	energy->nuclear = ints->Vnn;
+
+	//1-el energy. REMINDER: Only <i|h|i> terms contribute to it, twice because of the spin
+	energy->one_el = 0.0;
+	for (int i=0; i<o; i++){
+		energy->one_el += 2*ints->core_h[i*mo + i];
+	}
+
+	//2-el energy. J_ii = K_ii, so the i==j terms reduce to J_ii.
+	energy->coulomb = 0.0;
+	energy->exchange = 0.0;
+	double c_coulomb = 0.0, c_exchange = 0.0;
+	for (int i=0; i<o; i++){
+		for (int j=0; j<o; j++){
+			kahan_add(&energy->coulomb, &c_coulomb, 2*ints->J[i*o + j]);
+			kahan_add(&energy->exchange, &c_exchange, -ints->K[i*o + j]);
+		}
+	}
+	energy->two_el = energy->coulomb + energy->exchange;
+
+	energy->total = energy->nuclear + energy->one_el + energy->two_el;
+}
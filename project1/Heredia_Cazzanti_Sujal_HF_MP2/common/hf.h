@@ -0,0 +1,22 @@
+#ifndef HF_H
+#define HF_H
+
+#include "integrals.h"
+
+///////////////////////////////////// HARTREE-FOCK ENERGY //////////////////////////
+//Closed-shell HF energy of the orbitals stored in the file:
+//E = Vnn + 2 sum_i <i|h|i> + sum_ij (2 J_ij - K_ij), i,j occupied
+
+typedef struct {
+	double nuclear;   //Nuclear-nuclear repulsion
+	double one_el;    //2 sum_i <i|h|i>
+	double coulomb;   //sum_ij 2 J_ij
+	double exchange;  //-sum_ij K_ij (already carries the minus sign)
+	double two_el;    //coulomb + exchange
+	double total;
+} hf_energy_t;
+
+//Needs a context loaded with want_hf
+void hf_energy(const integrals_t* ints, hf_energy_t* energy);
+
+#endif
@@ -0,0 +1,726 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "integrals.h"
+#include "eri_stream.h"
+#include "eri_table.h"
+#include "eri_cache.h"
+#include "cholesky.h"
+#include "trace.h"
+#include "report.h"
+
+double* integrals_alloc(size_t count){
+	size_t bytes = count*sizeof(double);
+	bytes = (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT; //aligned_alloc wants a multiple of it
+	if ( bytes == 0 ) bytes = ARENA_ALIGNMENT;
+
+	double* ptr = aligned_alloc(ARENA_ALIGNMENT, bytes);
+	if ( ptr == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+	memset(ptr, 0, bytes);
+	return ptr;
+}
+
+//Frees a buffer of the context unless it lives in its arena
+static void context_free(const integrals_t* ints, void* ptr){
+	if ( !arena_owns(&ints->arena, ptr) ) free(ptr);
+}
+
+void integrals_default_options(integrals_options_t* opts){
+	opts->mem_limit = ERI_STREAM_DEFAULT_MEM_LIMIT;
+	opts->use_table = 0;
+	opts->use_cache = 0;
+	opts->cholesky_threshold = 0.0;
+	opts->frozen_core = 0;
+	opts->virtual_cutoff = HUGE_VAL;
+	opts->mp2_precision = STORE_DOUBLE;
+	opts->precision_check = 0;
+	opts->want_hf = 0;
+	opts->want_mp2 = 0;
+	opts->want_fock = 0;
+	opts->huge_pages = 0;
+}
+
+int integrals_parse_option(int argc, char** argv, int* k, integrals_options_t* opts){
+	if ( strcmp(argv[*k], "--mem-limit") == 0 && *k+1 < argc ){
+		opts->mem_limit = eri_stream_parse_mem_limit(argv[++*k]);
+		if ( opts->mem_limit == 0 ){
+			printf("Invalid --mem-limit value: %s\n", argv[*k]);
+			exit(1);
+		}
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--eri-table") == 0 ){
+		opts->use_table = 1;
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--eri-cache") == 0 ){
+		opts->use_cache = 1;
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--huge-pages") == 0 ){
+		opts->huge_pages = 1;
+		return 1;
+	}
+	return 0;
+}
+
+int integrals_parse_mp2_option(int argc, char** argv, int* k, integrals_options_t* opts){
+	if ( strcmp(argv[*k], "--cholesky") == 0 && *k+1 < argc ){
+		char* end;
+		opts->cholesky_threshold = strtod(argv[++*k], &end);
+		if ( *end != '\0' || !(opts->cholesky_threshold > 0.0) ){
+			printf("Invalid --cholesky value: %s\n", argv[*k]);
+			exit(1);
+		}
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--frozen-core") == 0 && *k+1 < argc ){
+		char* end;
+		if ( strcmp(argv[++*k], "auto") == 0 ) opts->frozen_core = FROZEN_CORE_AUTO;
+		else{
+			opts->frozen_core = (int)strtol(argv[*k], &end, 10);
+			if ( *end != '\0' || opts->frozen_core < 0 ){
+				printf("Invalid --frozen-core value: %s\n", argv[*k]);
+				exit(1);
+			}
+		}
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--virtual-cutoff") == 0 && *k+1 < argc ){
+		char* end;
+		opts->virtual_cutoff = strtod(argv[++*k], &end);
+		if ( *end != '\0' ){
+			printf("Invalid --virtual-cutoff value: %s\n", argv[*k]);
+			exit(1);
+		}
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--mp2-precision") == 0 && *k+1 < argc ){
+		const char* name = argv[++*k];
+		if ( strcmp(name, "double") == 0 ) opts->mp2_precision = STORE_DOUBLE;
+		else if ( strcmp(name, "float") == 0 ) opts->mp2_precision = STORE_FLOAT;
+		else if ( strcmp(name, "half") == 0 ) opts->mp2_precision = STORE_HALF;
+		else{
+			printf("Invalid --mp2-precision value: %s\n", name);
+			exit(1);
+		}
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--precision-check") == 0 ){
+		opts->precision_check = 1;
+		return 1;
+	}
+	return 0;
+}
+
+///////////////////////////////////// TWO-ELECTRON STORES //////////////////////////
+//The (oo|oo) bucket gives the HF Coulomb and exchange integrals. The stored permutation of <ij|ij> always has
+//p==r and q==s, the one of <ij|ji> either p==s and q==r or, as <ii|jj>, p==q and r==s. <ii|ii> is both.
+//Returns 1 if the integral was stored.
+static int hf_add(integrals_t* ints, int p, int q, int r, int s, double value){
+	int o = ints->num_elec;
+	if ( p==r && q==s ){
+		ints->nJ++;
+		TRACE(TRACE_INTEGRAL, "Indexes:%d %d %d %d COULOMB %f \n", p, q, r, s, value);
+		ints->J[p*o + q] = ints->J[q*o + p] = value;
+		if ( p==q ){
+			ints->nK++;
+			ints->K[p*o + p] = value;
+		}
+	}
+	else if ( p==s && q==r ){
+		ints->nK++;
+		TRACE(TRACE_INTEGRAL, "Indexes:%d %d %d %d EXCHANGE %f \n", p, q, r, s, value);
+		ints->K[p*o + q] = ints->K[q*o + p] = value;
+	}
+	else if ( p==q && r==s ){
+		ints->nK++;
+		TRACE(TRACE_INTEGRAL, "Indexes:%d %d %d %d EXCHANGE %f \n", p, q, r, s, value);
+		ints->K[p*o + r] = ints->K[r*o + p] = value;
+	}
+	else{
+		return 0;
+	}
+	return 1;
+}
+
+//Splits the chemist pair {p,r}, one occupied and one virtual orbital, into (active occupied, active virtual).
+//Returns 0 if the pair leaves the MP2 window.
+static inline int ov_pair(const mp2_window_t* w, int nocc, int p, int r, int* i, int* a){
+	if (p < nocc){ *i = w->active[p]; *a = w->active[r]; }
+	else{ *i = w->active[r]; *a = w->active[p]; }
+	return *i >= 0 && *a >= 0;
+}
+
+//Two-electron integrals obey 8-fold permutational symmetry and TREXIO stores only one permutation for each
+//quartet, so every stored <pq|rs> = (pr|qs) of the (ov|ov) bucket is seen once: both chemist pairs {p,r} and {q,s}
+//couple an occupied with a virtual orbital, and the value is scattered into K_ij[a][b] = (ia|jb). Since
+//(ia|jb) = (jb|ia), K_ji is the transpose of K_ij and both are written, so the MP2 kernel only reads contiguous rows.
+static int ovov_add(integrals_t* ints, int p, int q, int r, int s, double value){
+	ovov_blocks_t* K = &ints->ovov;
+	int i, a, j, b;
+	if (!ov_pair(&ints->window, ints->num_elec, p, r, &i, &a)) return 0;
+	if (!ov_pair(&ints->window, ints->num_elec, q, s, &j, &b)) return 0;
+	K->stored += ( i == j && a == b ) ? 1 : 2; //K_ij[a][b] and K_ji[b][a], the same value when i==j and a==b
+
+	if ( K->val != NULL ){
+		ovov_block(K, i, j)[(int64_t)a*K->nvirt + b] = value;
+		ovov_block(K, j, i)[(int64_t)b*K->nvirt + a] = value;
+		return 1;
+	}
+	//Reduced precision: block (i,j) with i<=j only, the diagonal blocks are symmetric
+	if ( i > j ){
+		int t = i; i = j; j = t;
+		t = a; a = b; b = t;
+	}
+	float* Kij = K->val_f + ovov_pair_index(i, j)*K->nvirt*K->nvirt;
+	Kij[(int64_t)a*K->nvirt + b] = (float)value;
+	if ( i == j ) Kij[(int64_t)b*K->nvirt + a] = (float)value;
+	return 1;
+}
+
+///////////////////////////////////// REDUCED PRECISION MP2 STORE //////////////////////////
+//IEEE half precision: 1 sign bit, 5 exponent bits (bias 15), 10 mantissa bits, subnormals below 2^-14. Converted by
+//hand so that no compiler support for _Float16 is needed. Rounds to nearest, ties to even.
+static uint16_t half_from_float(float f){
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t mag = x & 0x7FFFFFFF;
+	if ( mag >= 0x477FF000 ) return (uint16_t)(sign | 0x7C00); //Rounds above the largest half, 65504
+	if ( mag < 0x33000001 ) return (uint16_t)sign;             //Rounds to zero, at most 2^-25
+
+	int e = (int)(mag >> 23);
+	uint32_t m = (mag & 0x7FFFFF) | 0x800000; //24 significant bits
+	int shift;        //Bits of m dropped
+	uint32_t base;    //Exponent field of the result, the mantissa carry can bump it
+	if ( e < 113 ){   //Subnormal half: m * 2^(e-150) = (m >> shift) * 2^-24
+		shift = 126 - e;
+		base = 0;
+	}
+	else{
+		shift = 13;
+		base = (uint32_t)(e - 112) << 10;
+		m &= 0x7FFFFF; //The implicit bit is in the exponent field
+	}
+	uint32_t h = base + (m >> shift);
+	uint32_t rest = m & ((1u << shift) - 1), half_way = 1u << (shift - 1);
+	if ( rest > half_way || (rest == half_way && (h & 1)) ) h++;
+	return (uint16_t)(sign | h);
+}
+
+static float half_to_float(uint16_t h){
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t e = (h >> 10) & 0x1F;
+	uint32_t m = h & 0x3FF;
+	if ( e == 0 ){
+		float f = (float)m * 0x1p-24f; //Zero or subnormal
+		return sign ? -f : f;
+	}
+	uint32_t x = sign | ((e + 112) << 23) | (m << 13); //e == 31 (infinity) is never stored
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+//Half precision store (val_h and scale, allocated) from the float one read from the file: each block is divided by
+//its largest magnitude, so the values are in [-1,1] where half precision has 11 significant bits. The float store is
+//left to the caller.
+static void ovov_to_half(ovov_blocks_t* K){
+	int64_t nblocks = (int64_t)K->nocc*(K->nocc+1)/2;
+	int64_t block = (int64_t)K->nvirt*K->nvirt;
+
+	#pragma omp parallel for schedule(static)
+	for (int64_t ij=0; ij<nblocks; ij++){
+		const float* in = K->val_f + ij*block;
+		uint16_t* out = K->val_h + ij*block;
+		double largest = 0.0;
+		for (int64_t ab=0; ab<block; ab++) if ( fabs(in[ab]) > largest ) largest = fabs(in[ab]);
+		K->scale[ij] = (largest > 0.0) ? largest : 1.0;
+		float inv = (float)(1.0/K->scale[ij]);
+		for (int64_t ab=0; ab<block; ab++) out[ab] = half_from_float(in[ab]*inv);
+	}
+}
+
+double ovov_value(const ovov_blocks_t* K, int i, int j, int a, int b){
+	if ( K->val != NULL ) return ovov_block(K, i, j)[(int64_t)a*K->nvirt + b];
+	if ( i > j ){
+		int t = i; i = j; j = t;
+		t = a; a = b; b = t;
+	}
+	int64_t ij = ovov_pair_index(i, j);
+	int64_t at = ij*K->nvirt*K->nvirt + (int64_t)a*K->nvirt + b;
+	if ( K->val_f != NULL ) return K->val_f[at];
+	return K->scale[ij] * half_to_float(K->val_h[at]);
+}
+
+void ovov_unpack(const ovov_blocks_t* K, int i, int j, double* Kij){
+	int nvirt = K->nvirt;
+	int64_t block = (int64_t)nvirt*nvirt;
+	if ( K->val != NULL ){
+		memcpy(Kij, ovov_block(K, i, j), (size_t)block*sizeof(double));
+		return;
+	}
+	int transpose = ( i > j ); //K_ij = K_ji^T, only the block (j,i) is stored
+	int64_t ij = transpose ? ovov_pair_index(j, i) : ovov_pair_index(i, j);
+	const float* in_f = (K->val_f != NULL) ? K->val_f + ij*block : NULL;
+	const uint16_t* in_h = (K->val_h != NULL) ? K->val_h + ij*block : NULL;
+	double scale = (in_h != NULL) ? K->scale[ij] : 1.0;
+
+	for (int a=0; a<nvirt; a++){
+		for (int b=0; b<nvirt; b++){
+			int64_t at = transpose ? (int64_t)b*nvirt + a : (int64_t)a*nvirt + b;
+			Kij[(int64_t)a*nvirt + b] = (in_f != NULL) ? in_f[at] : scale * half_to_float(in_h[at]);
+		}
+	}
+}
+
+///////////////////////////////////// CLASS BUCKETS //////////////////////////
+//Integrals of one class from the current chunk, contiguous, with the index width of the chunk
+#define BUCKET_ENTRY_BYTES (4*sizeof(int32_t) + sizeof(double)) //Per integral of capacity
+typedef struct {
+	unsigned char* indexes;
+	double* values;
+	int64_t n;
+	int64_t capacity;
+} eri_bucket_t;
+
+//State of the chunk consumer: which classes have a store, and their buckets
+typedef struct {
+	integrals_t* ints;
+	unsigned char* virt;      //1 for the virtual MOs, 0 for the occupied ones [mo]
+	int wanted[ERI_CLASSES];  //Classes with a store, the only ones with a bucket
+	eri_bucket_t bucket[ERI_CLASSES];
+} ingest_t;
+
+//Class of (pr|qs): the number of virtual orbitals in each chemist pair, 0 to 2, picks it
+static const unsigned char class_of[3][3] = {
+	{ ERI_OOOO, ERI_OOOV, ERI_OOVV },
+	{ ERI_OOOV, ERI_OVOV, ERI_OVVV },
+	{ ERI_OOVV, ERI_OVVV, ERI_VVVV }
+};
+
+static void ingest_init(ingest_t* in, integrals_t* ints){
+	memset(in, 0, sizeof(*in));
+	in->ints = ints;
+	in->virt = malloc((size_t)ints->mo + 1);
+	if ( in->virt == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+	for (int p=0; p<ints->mo; p++) in->virt[p] = ( p >= ints->num_elec );
+	in->wanted[ERI_OOOO] = ( ints->J != NULL );
+	in->wanted[ERI_OVOV] = ovov_stored(&ints->ovov);
+}
+
+static void ingest_free(ingest_t* in){
+	free(in->virt);
+	in->virt=NULL;
+	for (int c=0; c<ERI_CLASSES; c++){
+		arena_heap_sub(&in->ints->arena, (size_t)in->bucket[c].capacity*BUCKET_ENTRY_BYTES);
+		free(in->bucket[c].indexes);
+		in->bucket[c].indexes=NULL;
+		free(in->bucket[c].values);
+		in->bucket[c].values=NULL;
+	}
+}
+
+//Room for one more integral. The buckets keep their memory from chunk to chunk and are sized for 4-byte indexes,
+//so they only grow while the first chunks are read. They hold the wanted classes only, a small part of each chunk.
+//Growing, they stay on the heap and are declared to the arena of the context.
+static inline void bucket_reserve(arena_t* arena, eri_bucket_t* bucket){
+	if ( bucket->n < bucket->capacity ) return;
+	int64_t grown = (bucket->capacity > 0) ? 2*bucket->capacity : 1024;
+	arena_heap_add(arena, (size_t)(grown - bucket->capacity)*BUCKET_ENTRY_BYTES);
+	bucket->capacity = grown;
+	bucket->indexes = realloc(bucket->indexes, (size_t)bucket->capacity*4*sizeof(int32_t));
+	bucket->values = realloc(bucket->values, (size_t)bucket->capacity*sizeof(double));
+	if ( bucket->indexes == NULL || bucket->values == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+}
+
+//Classifies every integral of a chunk once: the ones of a wanted class are appended to its bucket, the others are
+//only counted
+#define BUCKET_CHUNK(index_t, chunk, in, count) do { \
+	const index_t* idx_ = (const index_t*)(chunk)->indexes; \
+	for (int64_t m=0; m<(chunk)->n; m++){ \
+		const index_t* x_ = idx_ + 4*m; \
+		int c_ = class_of[(in)->virt[x_[0]] + (in)->virt[x_[2]]][(in)->virt[x_[1]] + (in)->virt[x_[3]]]; \
+		(count)[c_]++; \
+		if ( !(in)->wanted[c_] ) continue; \
+		eri_bucket_t* b_ = &(in)->bucket[c_]; \
+		bucket_reserve(&(in)->ints->arena, b_); \
+		memcpy((index_t*)b_->indexes + 4*b_->n, x_, 4*sizeof(index_t)); \
+		b_->values[b_->n++] = (chunk)->values[m]; \
+	} \
+} while (0)
+
+//Chunk consumer: the chunk is split into its class buckets, then each store walks its own bucket
+static void integrals_add_chunk(const eri_chunk_t* chunk, void* ctx){
+	ingest_t* in = (ingest_t*)ctx;
+	integrals_t* ints = in->ints;
+	double t0 = report_time();
+
+	int64_t count[ERI_CLASSES] = { 0 };
+	for (int c=0; c<ERI_CLASSES; c++) in->bucket[c].n = 0;
+	switch ( chunk->width ){
+		case 1: BUCKET_CHUNK(uint8_t, chunk, in, count); break;
+		case 2: BUCKET_CHUNK(uint16_t, chunk, in, count); break;
+		default: BUCKET_CHUNK(int32_t, chunk, in, count); break;
+	}
+	for (int c=0; c<ERI_CLASSES; c++) ints->class_count[c] += count[c];
+
+	int64_t used = 0;
+	if ( in->wanted[ERI_OOOO] ){
+		const eri_bucket_t* b = &in->bucket[ERI_OOOO];
+		eri_chunk_t oooo = { b->n, chunk->width, b->indexes, b->values };
+		for (int64_t m=0; m<oooo.n; m++){
+			used += hf_add(ints, eri_chunk_index(&oooo, m, 0), eri_chunk_index(&oooo, m, 1),
+			               eri_chunk_index(&oooo, m, 2), eri_chunk_index(&oooo, m, 3), oooo.values[m]);
+		}
+	}
+	if ( in->wanted[ERI_OVOV] ){
+		const eri_bucket_t* b = &in->bucket[ERI_OVOV];
+		eri_chunk_t ovov = { b->n, chunk->width, b->indexes, b->values };
+		for (int64_t m=0; m<ovov.n; m++){
+			used += ovov_add(ints, eri_chunk_index(&ovov, m, 0), eri_chunk_index(&ovov, m, 1),
+			                 eri_chunk_index(&ovov, m, 2), eri_chunk_index(&ovov, m, 3), ovov.values[m]);
+		}
+	}
+	REPORT_COUNT(integrals_used, used);
+	REPORT_TIME(REPORT_INGEST, t0);
+}
+
+static void ovov_free(const integrals_t* ints, ovov_blocks_t* K){
+	context_free(ints, K->val);
+	K->val=NULL;
+	context_free(ints, K->val_f);
+	K->val_f=NULL;
+	context_free(ints, K->val_h);
+	K->val_h=NULL;
+	context_free(ints, K->scale);
+	K->scale=NULL;
+}
+
+///////////////////////////////////// LOADER //////////////////////////
+//Frozen core orbitals of an atom of charge Z: the shells of the previous noble gas
+static int core_orbitals(double Z){
+	static const int noble_Z[] = { 2, 10, 18, 36, 54, 86 };
+	static const int noble_core[] = { 1, 5, 9, 18, 27, 43 }; //Orbitals of the noble gas that are core for Z above it
+	int core = 0;
+	for (int n=0; n<6; n++){
+		if ( Z > noble_Z[n] + 0.5 ) core = noble_core[n];
+	}
+	return core;
+}
+
+//Number of frozen core orbitals from the nuclear charges. Called with the TREXIO lock held.
+static trexio_exit_code read_frozen_core(trexio_t* trexio_file, int* nfrozen){
+	trexio_exit_code rc;
+	int32_t nucleus_num;
+	rc = trexio_read_nucleus_num(trexio_file, &nucleus_num);
+	if ( rc != TREXIO_SUCCESS ){
+		printf("Error reading the number of nuclei: %s\n", trexio_string_of_error(rc));
+		return rc;
+	}
+	double* charge = malloc((size_t)nucleus_num*sizeof(double) + 1);
+	if ( charge == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+	rc = trexio_read_nucleus_charge(trexio_file, charge);
+	if ( rc != TREXIO_SUCCESS ){
+		printf("Error reading the nuclear charges: %s\n", trexio_string_of_error(rc));
+	}
+	else{
+		*nfrozen = 0;
+		for (int n=0; n<nucleus_num; n++) *nfrozen += core_orbitals(charge[n]);
+	}
+	free(charge);
+	charge=NULL;
+	return rc;
+}
+
+//MP2 active space: drops the 'nfrozen' lowest occupied orbitals and the virtual ones above 'cutoff'. Returns 0 if
+//nothing is left to correlate.
+static int window_build(integrals_t* ints, int nfrozen, double cutoff){
+	mp2_window_t* w = &ints->window;
+	int mo = ints->mo;
+	int o = ints->num_elec;
+	const double* e = ints->mo_energy;
+
+	w->orbital = arena_alloc(&ints->arena, (size_t)mo*sizeof(int));
+	w->active = arena_alloc(&ints->arena, (size_t)mo*sizeof(int));
+	if ( nfrozen > o ) nfrozen = o;
+
+	//Occupied orbitals ranked by energy: the 'nfrozen' lowest are frozen, the others keep their MO order
+	w->nocc = 0;
+	for (int i=0; i<o; i++){
+		int below = 0;
+		for (int k=0; k<o; k++) below += ( e[k] < e[i] || (e[k] == e[i] && k < i) );
+		if ( below < nfrozen ) w->active[i] = -1;
+		else{
+			w->active[i] = w->nocc;
+			w->orbital[w->nocc++] = i;
+		}
+	}
+	w->nfrozen = o - w->nocc;
+
+	w->nvirt = 0;
+	for (int a=o; a<mo; a++){
+		if ( e[a] > cutoff ) w->active[a] = -1;
+		else{
+			w->active[a] = w->nvirt;
+			w->orbital[w->nocc + w->nvirt++] = a;
+		}
+	}
+	w->ndropped = mo - o - w->nvirt;
+	return w->nocc > 0 && w->nvirt > 0;
+}
+
+//Size of the arena of a context: every buffer it takes, for mo orbitals, o of them occupied, and 'integrals'
+//two-electron integrals in the file. The MP2 stores are counted for the whole window, the largest it can be.
+static size_t context_arena_bytes(const integrals_options_t* opts, int mo, int o, int64_t integrals){
+	size_t v = (mo > o) ? (size_t)(mo - o) : 0;
+	size_t pairs = (size_t)o*(o+1)/2;
+	size_t bytes = arena_round((size_t)mo*sizeof(double)) + arena_round((size_t)mo*mo*sizeof(double));
+	if ( opts->want_hf ) bytes += 2*arena_round((size_t)o*o*sizeof(double));
+	if ( opts->want_mp2 ){
+		bytes += 2*arena_round((size_t)mo*sizeof(int));
+		if ( opts->mp2_precision == STORE_DOUBLE ) bytes += arena_round((size_t)o*o*v*v*sizeof(double));
+		else bytes += arena_round(pairs*v*v*sizeof(float));
+		if ( opts->mp2_precision == STORE_HALF ){
+			bytes += arena_round(pairs*v*v*sizeof(uint16_t)) + arena_round(pairs*sizeof(double));
+		}
+		if ( opts->mp2_precision == STORE_DOUBLE && opts->cholesky_threshold > 0.0 ){
+			//Residual diagonal, then the factors (naux <= o*v): in place of the store, or above the kept ERI table
+			bytes += arena_round((size_t)o*v*sizeof(double));
+			if ( opts->want_fock ) bytes += arena_round((size_t)o*o*v*v*sizeof(double));
+		}
+	}
+	int64_t chunk = eri_stream_chunk_size(opts->mem_limit);
+	if ( opts->use_table || opts->use_cache || opts->want_fock ) bytes += eri_table_arena_bytes(integrals, chunk);
+	else bytes += eri_stream_arena_bytes(integrals, chunk);
+	return bytes;
+}
+
+//Everything but the two-electron integrals. Called with the TREXIO lock held.
+static trexio_exit_code read_metadata(trexio_t* trexio_file, const integrals_options_t* opts, integrals_t* ints){
+	trexio_exit_code rc;
+
+	//- Nuclear-Nuclear repulsion (Vnn)
+	rc = trexio_read_nucleus_repulsion(trexio_file, &ints->Vnn);
+	if ( rc != TREXIO_SUCCESS ){
+		printf("Error reading the nucleus repulsion: %s\n", trexio_string_of_error(rc));
+		return rc;
+	}
+	//- Number of spin-up electrons: stands for the number of occupied spatial orbitals
+	rc = trexio_read_electron_up_num(trexio_file, &ints->num_elec);
+	if ( rc != TREXIO_SUCCESS ){
+		printf("Error reading the number of electrons: %s\n", trexio_string_of_error(rc));
+		return rc;
+	}
+	//- Number of molecular orbitals (both virtual and occupied)
+	rc = trexio_read_mo_num(trexio_file, &ints->mo);
+	if ( rc != TREXIO_SUCCESS ){
+		printf("Error reading the number of molecular orbitals: %s\n", trexio_string_of_error(rc));
+		return rc;
+	}
+	int mo = ints->mo;
+	//- Number of two-electron integrals, which with the sizes above bounds the memory of the context
+	int64_t integrals;
+	rc = trexio_read_mo_2e_int_eri_size(trexio_file, &integrals);
+	if ( rc != TREXIO_SUCCESS ){
+		printf("Error reading the number of 2-electron integrals: %s\n", trexio_string_of_error(rc));
+		return rc;
+	}
+	arena_init(&ints->arena, context_arena_bytes(opts, mo, ints->num_elec, integrals), opts->huge_pages);
+
+	//- MO energies
+	ints->mo_energy = arena_alloc(&ints->arena, (size_t)mo*sizeof(double));
+	rc = trexio_read_mo_energy(trexio_file, ints->mo_energy);
+	if ( rc != TREXIO_SUCCESS ){
+		printf("Error reading the MO energies: %s\n", trexio_string_of_error(rc));
+		return rc;
+	}
+	//- Core Hamiltonian (kinetic energy plus electron-nucleus attraction), mo x mo
+	ints->core_h = arena_alloc(&ints->arena, (size_t)mo*mo*sizeof(double));
+	rc = trexio_read_mo_1e_int_core_hamiltonian(trexio_file, ints->core_h);
+	if ( rc != TREXIO_SUCCESS ){
+		printf("Error reading the 1-electron integrals: %s\n", trexio_string_of_error(rc));
+		return rc;
+	}
+	//- Frozen core of MP2, from the nuclear charges with --frozen-core auto
+	ints->window.nfrozen = opts->frozen_core;
+	if ( opts->want_mp2 && opts->frozen_core == FROZEN_CORE_AUTO ){
+		rc = read_frozen_core(trexio_file, &ints->window.nfrozen);
+		if ( rc != TREXIO_SUCCESS ) return rc;
+	}
+	return TREXIO_SUCCESS;
+}
+
+trexio_exit_code integrals_load(const char* filename, const integrals_options_t* opts, integrals_t* ints){
+	trexio_exit_code rc;
+	memset(ints, 0, sizeof(*ints));
+	ints->filename = filename;
+	if ( opts->cholesky_threshold > 0.0 && opts->mp2_precision != STORE_DOUBLE ){
+		//The rounding errors make the matrix slightly indefinite, and the residual no longer bounds the error
+		printf("--cholesky needs the double precision MP2 store\n");
+		return TREXIO_FAILURE;
+	}
+
+	double t0 = report_time();
+	eri_stream_lock();
+	trexio_t* trexio_file = trexio_open(filename, 'r', TREXIO_AUTO, &rc);
+	REPORT_TIME(REPORT_OPEN, t0);
+	if ( trexio_file == NULL || rc != TREXIO_SUCCESS ){
+		eri_stream_unlock();
+		printf("Error opening %s: %s\n", filename, trexio_string_of_error(rc));
+		return (rc != TREXIO_SUCCESS) ? rc : TREXIO_OPEN_ERROR;
+	}
+	TRACE(TRACE_PHASE, "%s: opened \n", filename);
+	t0 = report_time();
+	rc = read_metadata(trexio_file, opts, ints);
+	eri_stream_unlock();
+	REPORT_TIME(REPORT_METADATA, t0);
+	if ( rc != TREXIO_SUCCESS ) goto done;
+	TRACE(TRACE_PHASE, "%s: %d MOs, %d occupied \n", filename, ints->mo, ints->num_elec);
+
+	int o = ints->num_elec;
+	size_t store_mark = 0; //Arena below the MP2 store, or below its float copy in half precision
+
+	//- Two-electron stores: only the requested ones are allocated
+	if ( opts->want_hf ){
+		ints->J = arena_alloc(&ints->arena, (size_t)o*o*sizeof(double));
+		ints->K = arena_alloc(&ints->arena, (size_t)o*o*sizeof(double));
+	}
+	if ( opts->want_mp2 ){
+		if ( !window_build(ints, ints->window.nfrozen, opts->virtual_cutoff) ){
+			printf("No orbitals left to correlate: %d frozen core, %d virtual orbitals below %f\n",
+			       ints->window.nfrozen, ints->window.nvirt, opts->virtual_cutoff);
+			rc = TREXIO_FAILURE;
+			goto done;
+		}
+		//nocc^2 * nvirt^2 doubles over the active orbitals, independent of the total number of integrals
+		int nocc = ints->window.nocc;
+		int nvirt = ints->window.nvirt;
+		ints->ovov.nocc = nocc;
+		ints->ovov.nvirt = nvirt;
+		ints->ovov.precision = (store_precision_t)opts->mp2_precision;
+		if ( ints->ovov.precision == STORE_DOUBLE ){
+			store_mark = arena_mark(&ints->arena); //With --cholesky the factors take its place
+			ints->ovov.val = arena_alloc(&ints->arena, (size_t)nocc*nocc*nvirt*nvirt*sizeof(double));
+		}
+		else{
+			//Half precision is read into the float store and converted once every integral is in: the half store
+			//comes first, so that the float one is on top of the arena and released after the conversion
+			size_t count = (size_t)nocc*(nocc+1)/2*nvirt*nvirt;
+			if ( ints->ovov.precision == STORE_HALF ){
+				ints->ovov.val_h = arena_alloc(&ints->arena, count*sizeof(uint16_t));
+				ints->ovov.scale = arena_alloc(&ints->arena, (size_t)nocc*(nocc+1)/2*sizeof(double));
+			}
+			store_mark = arena_mark(&ints->arena);
+			ints->ovov.val_f = arena_alloc(&ints->arena, count*sizeof(float));
+		}
+		TRACE(TRACE_PHASE, "%s: MP2 window %d occupied (%d frozen), %d virtual (%d dropped) \n", filename, nocc,
+		      ints->window.nfrozen, nvirt, ints->window.ndropped);
+	}
+
+	//- Two-electron integrals, chunk by chunk (the chunk size follows --mem-limit)
+	int64_t chunk = eri_stream_chunk_size(opts->mem_limit);
+	ingest_t ingest;
+	ingest_init(&ingest, ints);
+	if ( opts->use_table || opts->use_cache || opts->want_fock ){
+		//The whole file is canonicalized and sorted first (or mapped from its cache), then handed to the
+		//stores in key order. The Fock builder keeps the table.
+		eri_table_t table = { NULL, 0, NULL, 0, 0 };
+		size_t mark = arena_mark(&ints->arena);
+		if ( opts->use_cache ){
+			ints->file_hash = eri_cache_hash_file(filename);
+			rc = eri_cache_table(trexio_file, filename, ints->file_hash, chunk, &ints->arena, &table);
+		}
+		else rc = eri_table_build(trexio_file, chunk, &ints->arena, &table);
+		if ( rc == TREXIO_SUCCESS ) eri_table_stream(&table, chunk, &ints->arena, integrals_add_chunk, &ingest);
+		if ( rc == TREXIO_SUCCESS && opts->want_fock ) ints->eri = table;
+		else{
+			//The stores are filled: the table goes, and the memory of the ones still to come starts below it
+			eri_table_free(&table);
+			arena_release(&ints->arena, mark);
+		}
+	}
+	else{
+		rc = eri_stream_read(trexio_file, chunk, &ints->arena, integrals_add_chunk, &ingest);
+	}
+	ingest_free(&ingest);
+	if ( opts->want_mp2 ){
+		REPORT_COUNT(store_missing, (int64_t)ints->ovov.nocc*ints->ovov.nocc*ints->ovov.nvirt*ints->ovov.nvirt -
+		                            ints->ovov.stored);
+	}
+	if ( rc != TREXIO_SUCCESS ){
+		printf("Error reading the 2-electron integrals: %s\n", trexio_string_of_error(rc));
+	}
+	TRACE(TRACE_PHASE, "%s: 2-electron integrals read, %d Coulomb and %d exchange \n", filename, ints->nJ, ints->nK);
+	TRACE(TRACE_PHASE, "%s: (oo|oo) %lld, (oo|ov) %lld, (oo|vv) %lld, (ov|ov) %lld, (ov|vv) %lld, (vv|vv) %lld \n",
+	      filename, (long long)ints->class_count[ERI_OOOO], (long long)ints->class_count[ERI_OOOV],
+	      (long long)ints->class_count[ERI_OOVV], (long long)ints->class_count[ERI_OVOV],
+	      (long long)ints->class_count[ERI_OVVV], (long long)ints->class_count[ERI_VVVV]);
+
+	//- Half precision MP2 store. The float store goes with the top of the arena, unless the ERI table kept for the
+	//Fock builder is above it.
+	if ( rc == TREXIO_SUCCESS && ints->ovov.precision == STORE_HALF && ints->ovov.val_f != NULL ){
+		t0 = report_time();
+		ovov_to_half(&ints->ovov);
+		if ( !ints->eri.in_arena ) arena_release(&ints->arena, store_mark);
+		ints->ovov.val_f = NULL;
+		REPORT_TIME(REPORT_INGEST, t0);
+	}
+
+	//- MP2 store replaced by its Cholesky factors: O(N^3) memory from here on. They take the place of the store in
+	//the arena, or go above the ERI table kept for the Fock builder.
+	if ( rc == TREXIO_SUCCESS && opts->want_mp2 && opts->cholesky_threshold > 0.0 ){
+		t0 = report_time();
+		size_t release = ( ints->eri.in_arena ) ? arena_mark(&ints->arena) : store_mark;
+		cholesky_decompose(&ints->ovov, opts->cholesky_threshold, &ints->arena, release, &ints->ovov_factors);
+		ovov_free(ints, &ints->ovov);
+		REPORT_TIME(REPORT_DECOMPOSE, t0);
+		TRACE(TRACE_PHASE, "%s: %d Cholesky vectors, error %e \n", filename, ints->ovov_factors.naux,
+		      ints->ovov_factors.error);
+	}
+
+done:
+	REPORT_COUNT(arena_high_water, (int64_t)ints->arena.high_water);
+	TRACE(TRACE_PHASE, "%s: arena high-water mark %zu of %zu bytes, %zu in use \n", filename, ints->arena.high_water,
+	      ints->arena.size, ints->arena.used);
+	t0 = report_time();
+	eri_stream_lock();
+	trexio_close(trexio_file);
+	eri_stream_unlock();
+	REPORT_TIME(REPORT_TEARDOWN, t0);
+	return rc;
+}
+
+void integrals_free(integrals_t* ints){
+	context_free(ints, ints->mo_energy);
+	ints->mo_energy=NULL;
+	context_free(ints, ints->core_h);
+	ints->core_h=NULL;
+	context_free(ints, ints->J);
+	ints->J=NULL;
+	context_free(ints, ints->K);
+	ints->K=NULL;
+	ovov_free(ints, &ints->ovov);
+	context_free(ints, ints->ovov_factors.B);
+	ints->ovov_factors.B=NULL;
+	eri_table_free(&ints->eri);
+	context_free(ints, ints->window.orbital);
+	ints->window.orbital=NULL;
+	context_free(ints, ints->window.active);
+	ints->window.active=NULL;
+	arena_free(&ints->arena);
+}
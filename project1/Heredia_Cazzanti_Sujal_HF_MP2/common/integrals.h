@@ -0,0 +1,158 @@
+#ifndef INTEGRALS_H
+#define INTEGRALS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <trexio.h>
+#include "eri_table.h"
+#include "arena.h"
+
+///////////////////////////////////// INTEGRAL CONTEXT //////////////////////////
+//Everything the HF and MP2 energies need from a TREXIO file, read in a single pass: nuclear repulsion, number of
+//occupied orbitals, MO energies, core Hamiltonian and the two-electron integral stores. The two-electron
+//integrals are streamed chunk by chunk (see eri_stream.h), every chunk is split by orbital class (eri_class_t) and
+//each requested store takes its own class, so a combined HF+MP2 run reads the file only once.
+//The buffers of a context come from its own arena (see arena.h): the read buffers and the ERI table are released
+//as soon as the stores are filled, and the peak is reported as arena_high_water_bytes.
+
+typedef struct {
+	size_t mem_limit; //Memory budget (bytes) for the integral read buffer (--mem-limit)
+	int use_table;    //Route the integrals through the canonical sorted ERI table (--eri-table)
+	int use_cache;    //Same, keeping the table in a sidecar file reused by later runs (--eri-cache)
+	double cholesky_threshold; //Factorize the MP2 store down to this residual (--cholesky TOL), 0 keeps it whole
+	int frozen_core;           //Core orbitals left out of MP2 (--frozen-core N), FROZEN_CORE_AUTO from the nuclei
+	double virtual_cutoff;     //Virtual orbitals above this energy are left out of MP2 (--virtual-cutoff E)
+	int mp2_precision;         //Precision of the MP2 store (--mp2-precision), one of store_precision_t
+	int precision_check;       //Also compute the MP2 energy with the double precision store (--precision-check)
+	int want_hf;      //Build the occupied Coulomb/exchange store used by the HF energy
+	int want_mp2;     //Build the (ia|jb) blocks used by the MP2 energy
+	int want_fock;    //Keep the canonical ERI table for the Fock matrix builder (see fock.h)
+	int huge_pages;   //Back the arena of the context with transparent huge pages (--huge-pages)
+} integrals_options_t;
+
+#define FROZEN_CORE_AUTO -1 //--frozen-core auto: one orbital per 1s shell, and so on for the inner shells of each atom
+
+//MP2 active space: the occupied orbitals above the frozen core and the virtual ones below the energy cutoff. Only
+//integrals with all four orbitals in it are stored.
+typedef struct {
+	int nocc, nvirt; //Active occupied and virtual orbitals
+	int nfrozen;     //Frozen core orbitals, the lowest occupied ones
+	int ndropped;    //Virtual orbitals above the cutoff
+	int* orbital;    //MO index of the active orbitals, occupied first [nocc+nvirt]
+	int* active;     //Inverse: position of each MO among the active orbitals of its class, -1 if not active [mo]
+} mp2_window_t;
+
+//Precision of the stored MP2 integrals
+typedef enum {
+	STORE_DOUBLE, //8 bytes per integral (default)
+	STORE_FLOAT,  //4 bytes, relative rounding error up to 6e-8
+	STORE_HALF    //2 bytes, IEEE half precision of the integrals divided by the largest one of their block: rounding
+	              //error up to 2.4e-4 of that largest integral
+} store_precision_t;
+
+//MP2 store: per-pair exchange blocks K_ij[a][b] = (ia|jb) = <ij|ab>, i,j active occupied and a,b active virtual.
+//In double precision all the nocc*nocc blocks are kept, so that the kernels read K_ij and K_ji = K_ij^T in place.
+//The reduced precision stores keep only the blocks i<=j (K_ji is the transpose) and are unpacked pair by pair into
+//double precision scratch blocks (see ovov_unpack): with 'half' the store takes 1/8 of the double one.
+typedef struct {
+	int nocc;     //Number of occupied orbitals
+	int nvirt;    //Number of virtual orbitals
+	store_precision_t precision;
+	double* val;  //Double: nocc*nocc blocks of nvirt*nvirt doubles, block (i,j) holds K_ij[a][b] = (ia|jb)
+	float* val_f; //Float (and half while reading): nocc*(nocc+1)/2 blocks of nvirt*nvirt floats, i<=j
+	uint16_t* val_h; //Half: same blocks as val_f, as IEEE half precision bit patterns of K_ij[a][b]/scale[ij]
+	double* scale;   //Half: largest magnitude of each block, nocc*(nocc+1)/2
+	int64_t stored;  //Values K_ij[a][b] of all the nocc*nocc blocks received from the file, the others stay 0
+} ovov_blocks_t;
+
+//Factorized MP2 store, from a pivoted Cholesky decomposition of the (o*v) x (o*v) matrix (ia|jb) (see cholesky.h):
+//(ia|jb) ~ sum_P B_i[P][a] B_j[P][b]
+typedef struct {
+	int nocc, nvirt;
+	int naux;     //Number of Cholesky vectors
+	double* B;    //nocc blocks of naux*nvirt doubles, block i holds B_i[P][a]
+	double error; //Largest diagonal element of the residual, which bounds all its elements
+} ovov_factors_t;
+
+//Classes of the two-electron integrals (pr|qs), in chemist notation, by the occupied (o) or virtual (v) type of
+//their orbitals. The 8-fold symmetry puts every stored integral in exactly one of them. Each chunk is bucketed by
+//class as it is read and every store only walks its own bucket: HF the (oo|oo) one, MP2 the (ov|ov) one. The
+//buckets no store asks for are only counted.
+typedef enum {
+	ERI_OOOO, //(oo|oo): HF Coulomb and exchange
+	ERI_OOOV, //(oo|ov)
+	ERI_OOVV, //(oo|vv), i.e. <ov|ov>
+	ERI_OVOV, //(ov|ov) = <oo|vv>: MP2
+	ERI_OVVV, //(ov|vv)
+	ERI_VVVV, //(vv|vv)
+	ERI_CLASSES
+} eri_class_t;
+
+typedef struct {
+	const char* filename; //TREXIO file the context was read from
+	uint64_t file_hash;   //Hash of its identity (see eri_cache_hash_file) when --eri-cache computed it, 0 otherwise
+	double Vnn;           //Nuclear repulsion
+	int num_elec;         //Number of spin-up electrons, i.e. of occupied spatial orbitals
+	int mo;               //Number of molecular orbitals, occupied and virtual
+	double* mo_energy;    //MO energies eps_p [mo]
+	double* core_h;       //Core Hamiltonian <p|h|q> [mo*mo], row-major
+
+	//HF store (NULL unless want_hf): occupied Coulomb J_ij = <ij|ij> and exchange K_ij = <ij|ji> = <ii|jj>
+	double* J;            //[num_elec*num_elec]
+	double* K;            //[num_elec*num_elec]
+	int nJ, nK;           //Amount of Coulomb and exchange integrals found in the file
+	int64_t class_count[ERI_CLASSES]; //Integrals of the file in each class
+
+	mp2_window_t window;  //MP2 active space (want_mp2 only), the size of the MP2 stores
+	ovov_blocks_t ovov;   //MP2 store (empty unless want_mp2, and freed once factorized)
+	ovov_factors_t ovov_factors; //Factorized MP2 store (B NULL unless want_mp2 and --cholesky)
+	eri_table_t eri;      //Every integral, canonical and sorted (empty unless want_fock)
+	arena_t arena;        //Holds the buffers above and the temporaries of the read; the class buckets and the
+	                      //Cholesky vectors being built stay on the heap but count in its high-water mark
+} integrals_t;
+
+static inline double* ovov_block(const ovov_blocks_t* K, int i, int j){
+	return K->val + ((int64_t)i*K->nocc + j) * K->nvirt * K->nvirt;
+}
+
+//Position of the block (i,j), i<=j, in the reduced precision stores
+static inline int64_t ovov_pair_index(int i, int j){
+	return (int64_t)j*(j+1)/2 + i;
+}
+
+//Whether the MP2 store was built, in any precision
+static inline int ovov_stored(const ovov_blocks_t* K){
+	return K->val != NULL || K->val_f != NULL || K->val_h != NULL;
+}
+
+//K_ij[a][b] = (ia|jb), from a store of any precision
+double ovov_value(const ovov_blocks_t* K, int i, int j, int a, int b);
+
+//Copies the block K_ij into 'Kij' (nvirt*nvirt doubles), from a store of any precision
+void ovov_unpack(const ovov_blocks_t* K, int i, int j, double* Kij);
+
+void integrals_default_options(integrals_options_t* opts);
+
+//If argv[*k] is a loader option (--mem-limit SIZE, --eri-table, --eri-cache, --huge-pages) stores it in 'opts', moves
+//*k past its value and returns 1. Returns 0 for any other argument. Exits on an invalid value.
+int integrals_parse_option(int argc, char** argv, int* k, integrals_options_t* opts);
+
+//Usage string of the loader options, to be embedded in the usage message of the programs
+#define INTEGRALS_OPTIONS_USAGE "[--mem-limit SIZE] [--eri-table] [--eri-cache] [--huge-pages]"
+
+//Same for the options of the MP2 store (--cholesky TOL, --frozen-core auto|N, --virtual-cutoff E,
+//--mp2-precision double|float|half, --precision-check), only accepted by the programs that compute MP2
+int integrals_parse_mp2_option(int argc, char** argv, int* k, integrals_options_t* opts);
+#define INTEGRALS_MP2_OPTIONS_USAGE "[--cholesky TOL] [--frozen-core auto|N] [--virtual-cutoff E] " \
+	"[--mp2-precision double|float|half] [--precision-check]"
+
+//Reads 'filename' into 'ints'. Prints the reason and returns the TREXIO error code if a read fails.
+trexio_exit_code integrals_load(const char* filename, const integrals_options_t* opts, integrals_t* ints);
+
+void integrals_free(integrals_t* ints);
+
+//64-byte aligned allocation of 'count' doubles from the heap, set to zero, for the buffers of the callers. Exits if
+//the memory is not available.
+double* integrals_alloc(size_t count);
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "laplace.h"
+
+#define FIT_SAMPLES 256    //Points of [1,R] the weights are fitted on, log-spaced
+#define CHECK_SAMPLES 1024 //Points of [1,R] the error is measured on
+#define GRID 16            //Candidates for each end of the exponent range
+
+//The fit is done for 1/y on [1,R], y = x/xmin, R = xmax/xmin: 1/x = (1/xmin) (1/y).
+//Exponents are log-spaced between two ends; for given exponents the weights minimizing the squared relative error
+//over the samples are a linear least-squares problem, solved by Householder QR. The two ends are picked on a grid,
+//keeping the pair with the smallest largest error.
+
+static double sample(int m, int count, double R){
+	return (count == 1) ? 1.0 : exp(log(R) * m / (count - 1));
+}
+
+static void exponents(double lo, double hi, int n, double* t){
+	for (int k=0; k<n; k++) t[k] = (n == 1) ? exp(lo) : exp(lo + (hi - lo) * k / (n - 1));
+}
+
+//Least-squares weights for the exponents 't': minimizes sum_m (y_m sum_k w_k exp(-t_k y_m) - 1)^2.
+//'A' is FIT_SAMPLES*n scratch. Returns 0 if the system is rank deficient.
+static int fit_weights(const double* t, int n, double R, double* A, double* w){
+	double rhs[FIT_SAMPLES];
+	for (int m=0; m<FIT_SAMPLES; m++){
+		double y = sample(m, FIT_SAMPLES, R);
+		for (int k=0; k<n; k++) A[m*n + k] = y * exp(-t[k]*y);
+		rhs[m] = 1.0;
+	}
+
+	//Householder QR, applied to the right-hand side on the fly
+	for (int k=0; k<n; k++){
+		double norm = 0.0;
+		for (int m=k; m<FIT_SAMPLES; m++) norm += A[m*n + k]*A[m*n + k];
+		norm = sqrt(norm);
+		if ( norm == 0.0 ) return 0;
+		double alpha = (A[k*n + k] > 0.0) ? -norm : norm;
+		double vk = A[k*n + k] - alpha; //Householder vector v = (vk, A[k+1..][k])
+		double vnorm2 = vk*vk + norm*norm - A[k*n + k]*A[k*n + k];
+		if ( vnorm2 == 0.0 ) return 0;
+		A[k*n + k] = vk;
+		for (int c=k+1; c<n; c++){
+			double dot = 0.0;
+			for (int m=k; m<FIT_SAMPLES; m++) dot += A[m*n + k]*A[m*n + c];
+			double f = 2.0*dot/vnorm2;
+			for (int m=k; m<FIT_SAMPLES; m++) A[m*n + c] -= f*A[m*n + k];
+		}
+		double dot = 0.0;
+		for (int m=k; m<FIT_SAMPLES; m++) dot += A[m*n + k]*rhs[m];
+		double f = 2.0*dot/vnorm2;
+		for (int m=k; m<FIT_SAMPLES; m++) rhs[m] -= f*A[m*n + k];
+		A[k*n + k] = alpha; //Diagonal of R
+	}
+	for (int k=n-1; k>=0; k--){
+		double value = rhs[k];
+		for (int c=k+1; c<n; c++) value -= A[k*n + c]*w[c];
+		if ( fabs(A[k*n + k]) < 1e-300 ) return 0;
+		w[k] = value / A[k*n + k];
+	}
+	return 1;
+}
+
+static double max_error(const double* t, const double* w, int n, double R){
+	double error = 0.0;
+	for (int m=0; m<CHECK_SAMPLES; m++){
+		double y = sample(m, CHECK_SAMPLES, R);
+		double sum = 0.0;
+		for (int k=0; k<n; k++) sum += w[k]*exp(-t[k]*y);
+		double e = fabs(y*sum - 1.0);
+		if ( e > error ) error = e;
+	}
+	return error;
+}
+
+int laplace_fit(double xmin, double xmax, int npoints, laplace_quadrature_t* quad){
+	if ( !(xmin > 0.0) || xmax < xmin || npoints < 1 || npoints > LAPLACE_MAX_POINTS ) return 0;
+	double R = xmax/xmin;
+	int n = npoints;
+
+	double* A = malloc((size_t)FIT_SAMPLES*n*sizeof(double));
+	if ( A == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+
+	//Smallest exponent around 1/R (decay over the whole range), largest a few units (decay within [1,2])
+	double best = INFINITY;
+	double t[LAPLACE_MAX_POINTS], w[LAPLACE_MAX_POINTS];
+	for (int g=0; g<GRID; g++){
+		double lo = log(0.01/R) + (log(2.0) - log(0.01/R)) * g / (GRID - 1);
+		for (int h=0; h<GRID; h++){
+			double hi = log(0.5) + (log(100.0) - log(0.5)) * h / (GRID - 1);
+			if ( n > 1 && hi <= lo ) continue;
+			exponents(lo, hi, n, t);
+			if ( !fit_weights(t, n, R, A, w) ) continue;
+			double error = max_error(t, w, n, R);
+			if ( error < best ){
+				best = error;
+				for (int k=0; k<n; k++){
+					quad->t[k] = t[k]/xmin;
+					quad->w[k] = w[k]/xmin;
+				}
+			}
+			if ( n == 1 ) break; //A single exponent has no upper end
+		}
+	}
+	free(A);
+	A=NULL;
+
+	quad->npoints = n;
+	quad->xmin = xmin;
+	quad->xmax = xmax;
+	quad->error = best;
+	return isfinite(best);
+}
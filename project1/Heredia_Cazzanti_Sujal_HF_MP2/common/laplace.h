@@ -0,0 +1,23 @@
+#ifndef LAPLACE_H
+#define LAPLACE_H
+
+///////////////////////////////////// LAPLACE QUADRATURE //////////////////////////
+//1/x = int_0^inf exp(-x t) dt for x > 0, replaced by a short sum 1/x ~ sum_k w_k exp(-t_k x). For the MP2
+//denominators x = e_a + e_b - e_i - e_j each term factorizes as exp(t_k e_i) exp(t_k e_j) exp(-t_k e_a)
+//exp(-t_k e_b), which decouples the four orbital indices.
+
+#define LAPLACE_MAX_POINTS 32
+
+typedef struct {
+	int npoints;
+	double t[LAPLACE_MAX_POINTS];      //Exponents t_k
+	double w[LAPLACE_MAX_POINTS];      //Weights w_k
+	double xmin, xmax;                 //Range the quadrature was fitted on
+	double error;                      //Largest relative error |x sum_k w_k exp(-t_k x) - 1| on [xmin,xmax]
+} laplace_quadrature_t;
+
+//Fits 'npoints' exponents and weights on [xmin,xmax], 0 < xmin <= xmax. Returns 0 if the range or the number of
+//points is not valid.
+int laplace_fit(double xmin, double xmax, int npoints, laplace_quadrature_t* quad);
+
+#endif
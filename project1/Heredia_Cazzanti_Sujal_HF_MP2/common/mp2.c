@@ -0,0 +1,632 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mp2.h"
+#include "cholesky.h"
+#include "checkpoint.h"
+#include "eri_cache.h"
+#include "report.h"
+
+void mp2_default_options(mp2_options_t* opts){
+	opts->engine = MP2_ENGINE_SCALAR;
+	opts->isa = MP2_ISA_AUTO;
+	opts->tile = 0;
+	opts->laplace_points = 0;
+	opts->screen_tol = 0.0;
+	opts->checkpoint = NULL;
+	opts->restart = 0;
+}
+
+int mp2_parse_option(int argc, char** argv, int* k, mp2_options_t* opts){
+	if ( strcmp(argv[*k], "--mp2-engine") == 0 && *k+1 < argc ){
+		const char* name = argv[++*k];
+		if ( strcmp(name, "scalar") == 0 ){
+			opts->engine = MP2_ENGINE_SCALAR;
+		}
+		else if ( strcmp(name, "tiled") == 0 ){
+			opts->engine = MP2_ENGINE_TILED;
+		}
+		else if ( strcmp(name, "simd") == 0 ){
+			opts->engine = MP2_ENGINE_SIMD;
+		}
+		else{
+			printf("Invalid --mp2-engine value: %s\n", name);
+			exit(1);
+		}
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--mp2-isa") == 0 && *k+1 < argc ){
+		const char* name = argv[++*k];
+		mp2_isa_t isa;
+		for (isa=MP2_ISA_AUTO; isa<=MP2_ISA_AVX512; isa++){
+			if ( strcmp(name, mp2_isa_name(isa)) == 0 ) break;
+		}
+		if ( isa > MP2_ISA_AVX512 ){
+			printf("Invalid --mp2-isa value: %s\n", name);
+			exit(1);
+		}
+		opts->isa = isa;
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--mp2-tile") == 0 && *k+1 < argc ){
+		char* end;
+		if ( strcmp(argv[++*k], "auto") == 0 ) opts->tile = 0;
+		else{
+			opts->tile = (int)strtol(argv[*k], &end, 10);
+			if ( *end != '\0' || opts->tile < 1 ){
+				printf("Invalid --mp2-tile value: %s\n", argv[*k]);
+				exit(1);
+			}
+		}
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--screen") == 0 && *k+1 < argc ){
+		char* end;
+		opts->screen_tol = strtod(argv[++*k], &end);
+		if ( *end != '\0' || !(opts->screen_tol > 0.0) ){
+			printf("Invalid --screen value: %s\n", argv[*k]);
+			exit(1);
+		}
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--checkpoint") == 0 && *k+1 < argc ){
+		opts->checkpoint = argv[++*k];
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--restart") == 0 ){
+		opts->restart = 1;
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--laplace") == 0 && *k+1 < argc ){
+		opts->laplace_points = atoi(argv[++*k]);
+		if ( opts->laplace_points < 1 || opts->laplace_points > LAPLACE_MAX_POINTS ){
+			printf("Invalid --laplace value: %s (1 to %d points)\n", argv[*k], LAPLACE_MAX_POINTS);
+			exit(1);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+//K_ji[a][b] = K_ij[b][a], so both operands are read as contiguous rows and the b loop vectorizes.
+double mp2_pair_energy(const double* Kij, const double* Kji, const double* e_virt, int nvirt, double e_ij,
+                       const int* rows, int nrows){
+	double pair = 0.0;
+
+	for (int r=0; r<nrows; r++){
+		int a = (rows != NULL) ? rows[r] : r;
+		const double* Kij_a = Kij + (int64_t)a*nvirt;
+		const double* Kji_a = Kji + (int64_t)a*nvirt;
+		double e_ija = e_ij - e_virt[a];
+
+		for (int b=0; b<nvirt; b++){
+			pair += Kij_a[b] * ( (2.0*Kij_a[b]) - Kji_a[b] ) / (e_ija - e_virt[b]);
+		}
+	}
+	return pair;
+}
+
+//K_ji[a][b] = K_ij[b][a] is read from the transposed tile, so a pair touches only K_ij: half the memory traffic of
+//mp2_pair_energy, and no K_ji block to rebuild with the Cholesky factors. The terms (a,b) and (b,a) share both
+//integrals and the denominator, so tile (A,B) is summed together with (B,A), which also halves the divisions. The
+//(B,A) tile is first copied transposed into an L1-resident buffer, so that the b loop reads both tiles, the mask and
+//the e_virt slice contiguously and vectorizes.
+#define TILE_LANES 4
+
+double mp2_pair_energy_tiled(const double* Kij, const double* e_virt, int nvirt, double e_ij, const double* keep,
+                             int tile){
+	double Y[MP2_TILE_MAX*MP2_TILE_MAX]; //Y[a-A][b-B] = K_ij[b][a]
+	double pair = 0.0;
+	if ( tile > MP2_TILE_MAX ) tile = MP2_TILE_MAX;
+
+	for (int A=0; A<nvirt; A+=tile){
+		int A_end = (A + tile < nvirt) ? A + tile : nvirt;
+		for (int B=A; B<nvirt; B+=tile){
+			int B_end = (B + tile < nvirt) ? B + tile : nvirt;
+			for (int b=B; b<B_end; b++){
+				for (int a=A; a<A_end; a++) Y[(a-A)*tile + (b-B)] = Kij[(int64_t)b*nvirt + a];
+			}
+
+			for (int a=A; a<A_end; a++){
+				const double* restrict X_a = Kij + (int64_t)a*nvirt; //K_ij[a][b] = K_ji[b][a]
+				const double* restrict Y_a = Y + (a-A)*tile;         //Y_a[b-B] = K_ij[b][a] = K_ji[a][b]
+				double e_ija = e_ij - e_virt[a];
+				double keep_a = (keep != NULL) ? keep[a] : 1.0;
+				int b_start = B;
+				if ( A == B ){
+					//Diagonal tile: b > a only, and the a == b term once
+					pair += keep_a * X_a[a]*X_a[a] / (e_ija - e_virt[a]);
+					b_start = a + 1;
+				}
+
+				//TILE_LANES independent partial sums: no chain of dependent additions, and the compiler can pack
+				//the lanes into vector registers
+				double lane[TILE_LANES] = { 0.0 };
+				int b = b_start;
+				for (; b + TILE_LANES <= B_end; b += TILE_LANES){
+					for (int l=0; l<TILE_LANES; l++){
+						double x = X_a[b+l], y = Y_a[b-B+l];
+						double keep_b = (keep != NULL) ? keep[b+l] : 1.0;
+						lane[l] += ( keep_a * x * ( (2.0*x) - y ) + keep_b * y * ( (2.0*y) - x ) ) / (e_ija - e_virt[b+l]);
+					}
+				}
+				for (; b<B_end; b++){
+					double x = X_a[b], y = Y_a[b-B];
+					double keep_b = (keep != NULL) ? keep[b] : 1.0;
+					lane[0] += ( keep_a * x * ( (2.0*x) - y ) + keep_b * y * ( (2.0*y) - x ) ) / (e_ija - e_virt[b]);
+				}
+				double row = 0.0;
+				for (int l=0; l<TILE_LANES; l++) row += lane[l];
+				pair += row;
+			}
+		}
+	}
+	return pair;
+}
+
+//Tile size of the tiled engine: the fastest of a few candidates, timed on the block K_ij of one pair. Below
+//TILE_TUNE_MIN_TERMS terms in the whole pair loop the timing would cost more than it can save, and TILE_DEFAULT is used.
+#define TILE_DEFAULT 32
+#define TILE_TUNE_MIN_TERMS (1 << 22)
+
+static int tune_tile(const double* Kij, const double* e_virt, int nvirt, double e_ij, int64_t npairs){
+	static const int candidates[] = { 8, 16, 24, 32, 48, 64 };
+	if ( npairs*nvirt*nvirt < TILE_TUNE_MIN_TERMS ) return TILE_DEFAULT;
+
+	int best_tile = candidates[0];
+	double best_time = INFINITY;
+	volatile double sink = 0.0; //Keeps the timed calls from being optimized out
+
+	for (int c=0; c<(int)(sizeof(candidates)/sizeof(candidates[0])); c++){
+		int tile = candidates[c];
+		if ( tile > nvirt && c > 0 ) break; //Larger tiles than the block all behave the same
+
+		int calls = 0;
+		double t0 = report_time(), elapsed;
+		do {
+			sink += mp2_pair_energy_tiled(Kij, e_virt, nvirt, e_ij, NULL, tile);
+			calls++;
+			elapsed = report_time() - t0;
+		} while ( elapsed < 1e-3 && calls < 100 );
+		if ( elapsed/calls < best_time ){
+			best_time = elapsed/calls;
+			best_tile = tile;
+		}
+	}
+	(void)sink;
+	return best_tile;
+}
+
+//Each quadrature point k turns the denominator into a product of one factor per orbital, so a,b enter only through
+//S[k][a] S[k][b]: all the points are accumulated in one sweep over the rows of K_ij and K_ji.
+double mp2_pair_energy_laplace(const double* Kij, const double* Kji, const double* S, const laplace_quadrature_t* quad,
+                               int nvirt, double e_ij_mu, const int* rows, int nrows){
+	int npoints = quad->npoints;
+	double point_sum[LAPLACE_MAX_POINTS] = { 0.0 }; //sum_ab K (2K - K^T) S[k][a] S[k][b], for each point k
+
+	for (int r=0; r<nrows; r++){
+		int a = (rows != NULL) ? rows[r] : r;
+		const double* Kij_a = Kij + (int64_t)a*nvirt;
+		const double* Kji_a = Kji + (int64_t)a*nvirt;
+		for (int k=0; k<npoints; k++){
+			const double* S_k = S + (int64_t)k*nvirt;
+			double row = 0.0;
+			for (int b=0; b<nvirt; b++){
+				row += Kij_a[b] * ( (2.0*Kij_a[b]) - Kji_a[b] ) * S_k[b];
+			}
+			point_sum[k] += S_k[a] * row;
+		}
+	}
+
+	//1/(e_ij - e_a - e_b) = -1/x ~ -sum_k w_k exp(t_k (e_ij - 2mu)) exp(-t_k (e_a - mu)) exp(-t_k (e_b - mu))
+	double pair = 0.0;
+	for (int k=0; k<npoints; k++){
+		pair -= quad->w[k] * exp(quad->t[k]*e_ij_mu) * point_sum[k];
+	}
+	return pair;
+}
+
+//Schwarz factors Q[i][a] = sqrt((ia|ia)) = sqrt(K_ii[a][a]) of the active orbitals, from the loaded MP2 store
+static double* schwarz_factors(const integrals_t* ints){
+	int nocc = ints->window.nocc;
+	int nvirt = ints->window.nvirt;
+	const ovov_factors_t* factors = &ints->ovov_factors;
+	double* Q = integrals_alloc((size_t)nocc*nvirt);
+
+	for (int i=0; i<nocc; i++){
+		for (int a=0; a<nvirt; a++){
+			double diag = 0.0;
+			if ( factors->B != NULL ){
+				const double* Bi = factors->B + (int64_t)i*factors->naux*nvirt;
+				for (int P=0; P<factors->naux; P++) diag += Bi[(int64_t)P*nvirt + a]*Bi[(int64_t)P*nvirt + a];
+			}
+			else{
+				diag = ovov_value(&ints->ovov, i, i, a, a);
+			}
+			Q[(int64_t)i*nvirt + a] = sqrt(fabs(diag));
+		}
+	}
+	return Q;
+}
+
+//Rows a of the pair (i,j) kept by the screening: those whose integrals may reach 'tol', Q_ia max_b Q_jb >= tol.
+//Returns their number and adds to *bound the largest contribution the other rows could have had,
+//  sum_b |K_ij[a][b]| (2 |K_ij[a][b]| + |K_ji[a][b]|) / |D| <= Q_ia (2 Q_ia sum_b Q_jb^2 + Q_ja sum_b Q_ib Q_jb) / gap_a
+//since |K_ij[a][b]| <= Q_ia Q_jb, |K_ji[a][b]| = |(ib|ja)| <= Q_ib Q_ja and |D| >= gap_a = e_a + LUMO - e_i - e_j.
+static int screen_rows(const double* Q, const double* Q_max, const double* Q_sq, const double* e_virt, int nvirt,
+                       int i, int j, double e_ij, double lumo, double tol, int* rows, double* bound){
+	const double* Q_i = Q + (int64_t)i*nvirt;
+	const double* Q_j = Q + (int64_t)j*nvirt;
+	double cross = 0.0; //sum_b Q_ib Q_jb
+	for (int b=0; b<nvirt; b++) cross += Q_i[b]*Q_j[b];
+
+	int nrows = 0;
+	for (int a=0; a<nvirt; a++){
+		if ( Q_i[a]*Q_max[j] >= tol ) rows[nrows++] = a;
+		else *bound += Q_i[a]*(2.0*Q_i[a]*Q_sq[j] + Q_j[a]*cross)/(e_virt[a] + lumo - e_ij);
+	}
+	return nrows;
+}
+
+//Quadrature fitted on the denominators of this molecule, x = e_a + e_b - e_i - e_j in
+//[2 (LUMO - HOMO), 2 (highest virtual - lowest occupied)], and the factors S[k][a] = exp(-t_k (e_a - mu)).
+//Returns S, and mu in 'mu'. Exits if the orbital energies leave no gap.
+static double* laplace_setup(const double* e_occ, int nocc, const double* e_virt, int nvirt, int npoints,
+                             laplace_quadrature_t* quad, double* mu){
+	double occ_min = e_occ[0], homo = e_occ[0];
+	for (int i=1; i<nocc; i++){
+		if ( e_occ[i] < occ_min ) occ_min = e_occ[i];
+		if ( e_occ[i] > homo ) homo = e_occ[i];
+	}
+	double lumo = e_virt[0], virt_max = e_virt[0];
+	for (int a=1; a<nvirt; a++){
+		if ( e_virt[a] < lumo ) lumo = e_virt[a];
+		if ( e_virt[a] > virt_max ) virt_max = e_virt[a];
+	}
+	if ( !laplace_fit(2.0*(lumo - homo), 2.0*(virt_max - occ_min), npoints, quad) ){
+		printf("The Laplace quadrature needs a positive HOMO-LUMO gap (HOMO %f, LUMO %f)\n", homo, lumo);
+		exit(1);
+	}
+
+	*mu = 0.5*(homo + lumo);
+	double* S = integrals_alloc((size_t)npoints*nvirt);
+	for (int k=0; k<npoints; k++){
+		for (int a=0; a<nvirt; a++) S[(int64_t)k*nvirt + a] = exp(-quad->t[k]*(e_virt[a] - *mu));
+	}
+	return S;
+}
+
+//Identity of the pair energies of a run, for its checkpoints: the TREXIO file, the active space, what replaced the
+//double precision store and the options that change the energies. The kernel (engine, tile, ISA) is left out: it
+//only changes the last bits, and a run may be resumed with another one. Returns 0 if the file cannot be identified.
+static uint64_t run_fingerprint(const integrals_t* ints, const mp2_options_t* opts){
+	const mp2_window_t* w = &ints->window;
+	uint64_t file_hash = ( ints->file_hash != 0 ) ? ints->file_hash : eri_cache_hash_file(ints->filename);
+	if ( file_hash == 0 ) return 0;
+	uint64_t hash = checkpoint_hash(CHECKPOINT_HASH_SEED, &file_hash, sizeof(file_hash));
+	hash = checkpoint_hash(hash, &w->nocc, sizeof(w->nocc));
+	hash = checkpoint_hash(hash, &w->nvirt, sizeof(w->nvirt));
+	hash = checkpoint_hash(hash, w->orbital, (size_t)(w->nocc + w->nvirt)*sizeof(int));
+	hash = checkpoint_hash(hash, &ints->ovov.precision, sizeof(ints->ovov.precision));
+	hash = checkpoint_hash(hash, &ints->ovov_factors.naux, sizeof(ints->ovov_factors.naux));
+	hash = checkpoint_hash(hash, &ints->ovov_factors.error, sizeof(ints->ovov_factors.error));
+	hash = checkpoint_hash(hash, &opts->laplace_points, sizeof(opts->laplace_points));
+	hash = checkpoint_hash(hash, &opts->screen_tol, sizeof(opts->screen_tol));
+	return hash;
+}
+
+double mp2_energy(const integrals_t* ints, const mp2_options_t* opts, mp2_stats_t* stats){
+	const mp2_window_t* window = &ints->window;
+	int nocc = window->nocc;
+	int nvirt = window->nvirt;
+	const ovov_factors_t* factors = &ints->ovov_factors;
+	double emp2 = 0.0;
+
+	//Energies of the active orbitals (frozen core and virtuals above the cutoff left out)
+	double* e_occ = integrals_alloc((size_t)nocc + nvirt);
+	double* e_virt = e_occ + nocc;
+	for (int p=0; p<nocc+nvirt; p++) e_occ[p] = ints->mo_energy[window->orbital[p]];
+
+	laplace_quadrature_t quad;
+	double* S = NULL; //Laplace factors of the virtual orbitals, NULL without --laplace
+	double mu = 0.0;
+	if ( opts->laplace_points > 0 ) S = laplace_setup(e_occ, nocc, e_virt, nvirt, opts->laplace_points, &quad, &mu);
+	if ( stats != NULL ){
+		stats->laplace_points = (S != NULL) ? quad.npoints : 0;
+		stats->laplace_error = (S != NULL) ? quad.error : 0.0;
+	}
+
+	//Screening: per occupied orbital j, the largest Schwarz factor and the sum of their squares, and the lowest
+	//virtual energy, which bounds the denominators
+	double* Q = NULL; //NULL without --screen
+	double* Q_max = NULL;
+	double* Q_sq = NULL;
+	double lumo = 0.0;
+	if ( opts->screen_tol > 0.0 ){
+		Q = schwarz_factors(ints);
+		Q_max = integrals_alloc((size_t)nocc);
+		Q_sq = integrals_alloc((size_t)nocc);
+		for (int j=0; j<nocc; j++){
+			for (int b=0; b<nvirt; b++){
+				double q = Q[(int64_t)j*nvirt + b];
+				if ( q > Q_max[j] ) Q_max[j] = q;
+				Q_sq[j] += q*q;
+			}
+		}
+		double homo = e_occ[0];
+		lumo = e_virt[0];
+		for (int i=1; i<nocc; i++) if ( e_occ[i] > homo ) homo = e_occ[i];
+		for (int a=1; a<nvirt; a++) if ( e_virt[a] < lumo ) lumo = e_virt[a];
+		if ( !(lumo > homo) ){
+			printf("The screening bound needs a positive HOMO-LUMO gap (HOMO %f, LUMO %f)\n", homo, lumo);
+			exit(1);
+		}
+	}
+
+	//Each term is unchanged under the combined swap (i,a) <-> (j,b), hence e_ji = e_ij and
+	//E(MP2) = sum_i e_ii + 2 sum_{i<j} e_ij. Only the i<=j pairs are computed, one pair per task.
+	//Pairs have the same cost but are few, so they are handed out dynamically to keep all cores busy.
+	//Every pair energy is written to its own slot and the slots are summed afterwards in pair order:
+	//the result does not depend on the number of threads nor on the schedule.
+	int npairs = nocc*(nocc+1)/2;
+	int* pair_i = malloc(npairs*sizeof(int)); //Occupied indexes (i,j), i<=j, of each pair
+	int* pair_j = malloc(npairs*sizeof(int));
+	double* pair_energy = calloc(npairs, sizeof(double)); //Weighted pair energies
+	double* pair_bound = calloc(npairs, sizeof(double)); //Weighted bounds of the screened out contributions
+	int64_t* pair_screened = calloc(npairs, sizeof(int64_t)); //Terms screened out
+	char* pair_done = calloc(npairs + 1, 1); //Pairs completed, or restored from the checkpoint
+	if ( pair_i == NULL || pair_j == NULL || pair_energy == NULL || pair_bound == NULL || pair_screened == NULL ||
+	     pair_done == NULL ){
+		printf("Memory allocation went wrong");
+		exit(1);
+	}
+	for (int i=0, ij=0; i<nocc; i++){
+		for (int j=i; j<nocc; j++, ij++){
+			pair_i[ij] = i;
+			pair_j[ij] = j;
+		}
+	}
+
+	//Checkpoint: the pairs saved by a previous run of the same calculation are not computed again
+	mp2_checkpoint_t checkpoint = { opts->checkpoint, 0, npairs, pair_done, pair_energy, pair_bound, pair_screened,
+	                                report_time() };
+	if ( opts->checkpoint != NULL ){
+		checkpoint.fingerprint = run_fingerprint(ints, opts);
+		if ( opts->restart && checkpoint.fingerprint == 0 ){
+			printf("Cannot identify %s, starting from scratch \n", ints->filename);
+		}
+		else if ( opts->restart ){
+			int restored = checkpoint_load(&checkpoint);
+			if ( restored > 0 ) printf("Restarted from %s: %d of %d pairs already done \n", opts->checkpoint, restored, npairs);
+		}
+	}
+
+	//Tiled engine (used unless the Laplace quadrature replaces the denominators): tile size given, or timed on the
+	//first pair
+	int tile = 0;
+	if ( opts->engine == MP2_ENGINE_TILED && S == NULL && npairs > 0 ){
+		tile = opts->tile;
+		if ( tile == 0 ){
+			double* K00 = NULL;
+			if ( factors->B != NULL ){
+				K00 = integrals_alloc((size_t)nvirt*nvirt);
+				cholesky_block(factors, 0, 0, K00);
+			}
+			else if ( ints->ovov.val == NULL ){
+				K00 = integrals_alloc((size_t)nvirt*nvirt);
+				ovov_unpack(&ints->ovov, 0, 0, K00);
+			}
+			tile = tune_tile((K00 != NULL) ? K00 : ovov_block(&ints->ovov, 0, 0), e_virt, nvirt, 2.0*e_occ[0],
+			                 npairs);
+			free(K00);
+		}
+		if ( tile > MP2_TILE_MAX ) tile = MP2_TILE_MAX;
+	}
+	if ( stats != NULL ) stats->tile = tile;
+
+	//SIMD engine: the row kernel is chosen once, before the threads start, and kept by this call (concurrent calls of
+	//the batch driver may pick other ones)
+	mp2_isa_t isa = MP2_ISA_AUTO;
+	mp2_row_kernel_t row_kernel = NULL;
+	if ( opts->engine == MP2_ENGINE_SIMD && S == NULL ){
+		isa = opts->isa;
+		row_kernel = mp2_simd_select(&isa);
+	}
+	if ( stats != NULL ) stats->isa = isa;
+
+	//Hardware cache misses of the pair loop, summed over the threads, for the run report
+	report_t* report = report_current();
+	int64_t cache_misses = 0;
+	int counters_ok = 1;
+	int64_t lookups = 0; //(ia|jb) values read by the kernels
+
+	#pragma omp parallel
+	{
+		int counter = (report != NULL) ? report_counter_open() : -1;
+		int64_t thread_lookups = 0;
+
+		//Per-thread scratch blocks: the K_ij/K_ji blocks rebuilt from the Cholesky factors or unpacked from a reduced precision store. One pair each, small enough to stay in L2.
+		double* Kij_buf = NULL;
+		double* Kji_buf = NULL;
+		int* rows = NULL; //Rows kept by the screening
+		double* keep = NULL; //Same, as a 0/1 mask for the tiled engine
+		if ( Q != NULL ){
+			rows = malloc((size_t)nvirt*sizeof(int) + 1);
+			if ( rows == NULL ){
+				printf("Memory allocation went wrong");
+				exit(1);
+			}
+			if ( tile > 0 ) keep = integrals_alloc((size_t)nvirt);
+		}
+		if ( factors->B != NULL || ints->ovov.val == NULL ){
+			Kij_buf = integrals_alloc((size_t)nvirt*nvirt);
+			if ( tile == 0 ) Kji_buf = integrals_alloc((size_t)nvirt*nvirt); //The tiled engine reads K_ij only
+		}
+
+		#pragma omp for schedule(dynamic,1)
+		for (int ij=0; ij<npairs; ij++){
+			if ( pair_done[ij] ) continue;
+			int i = pair_i[ij];
+			int j = pair_j[ij];
+			double weight = (i == j) ? 1.0 : 2.0;
+			double e_ij = e_occ[i] + e_occ[j];
+
+			const double* Kij;
+			const double* Kji;
+			if ( factors->B != NULL ){
+				cholesky_block(factors, i, j, Kij_buf);
+				if ( Kji_buf != NULL ){
+					for (int a=0; a<nvirt; a++){
+						for (int b=0; b<nvirt; b++) Kji_buf[(int64_t)a*nvirt + b] = Kij_buf[(int64_t)b*nvirt + a];
+					}
+				}
+				Kij = Kij_buf;
+				Kji = Kji_buf;
+			}
+			else if ( ints->ovov.val == NULL ){
+				ovov_unpack(&ints->ovov, i, j, Kij_buf);
+				if ( Kji_buf != NULL ) ovov_unpack(&ints->ovov, j, i, Kji_buf);
+				Kij = Kij_buf;
+				Kji = Kji_buf;
+			}
+			else{
+				Kij = ovov_block(&ints->ovov, i, j);
+				Kji = ovov_block(&ints->ovov, j, i);
+			}
+
+			int nrows = nvirt;
+			double bound = 0.0;
+			if ( Q != NULL ){
+				nrows = screen_rows(Q, Q_max, Q_sq, e_virt, nvirt, i, j, e_ij, lumo, opts->screen_tol, rows, &bound);
+			}
+
+			double pair;
+			int64_t read = 2*(int64_t)nrows*nvirt; //Rows of K_ij and K_ji
+			if ( S != NULL ){
+				pair = mp2_pair_energy_laplace(Kij, Kji, S, &quad, nvirt, e_ij - 2.0*mu, rows, nrows);
+			}
+			else if ( tile > 0 ){
+				if ( keep != NULL ){
+					for (int a=0; a<nvirt; a++) keep[a] = 0.0;
+					for (int r=0; r<nrows; r++) keep[rows[r]] = 1.0;
+				}
+				pair = mp2_pair_energy_tiled(Kij, e_virt, nvirt, e_ij, keep, tile);
+				read = (int64_t)nvirt*nvirt; //The whole K_ij, and no K_ji
+			}
+			else if ( row_kernel != NULL ){
+				pair = mp2_pair_energy_simd(row_kernel, Kij, Kji, e_virt, nvirt, e_ij, rows, nrows);
+			}
+			else{
+				pair = mp2_pair_energy(Kij, Kji, e_virt, nvirt, e_ij, rows, nrows);
+			}
+			thread_lookups += read;
+
+			//With a checkpoint the results of the pair are stored, the pair marked done and the checkpoint written by
+			//one thread at a time: checkpoint_write only reads arrays no other thread is writing, and a checkpoint
+			//only ever holds finished pairs
+			if ( opts->checkpoint != NULL ){
+				#pragma omp critical(mp2_checkpoint)
+				{
+					pair_energy[ij] = weight * pair;
+					pair_bound[ij] = weight * bound;
+					pair_screened[ij] = (int64_t)weight*(nvirt - nrows)*nvirt;
+					pair_done[ij] = 1;
+					if ( report_time() - checkpoint.last_write >= MP2_CHECKPOINT_INTERVAL ) checkpoint_write(&checkpoint);
+				}
+			}
+			else{
+				pair_energy[ij] = weight * pair;
+				pair_bound[ij] = weight * bound;
+				pair_screened[ij] = (int64_t)weight*(nvirt - nrows)*nvirt;
+			}
+		}
+
+		int64_t misses = report_counter_close(counter);
+		#pragma omp critical
+		{
+			if ( misses < 0 ) counters_ok = 0;
+			else cache_misses += misses;
+			lookups += thread_lookups;
+		}
+
+		free(keep);
+		free(rows);
+		free(Kij_buf);
+		free(Kji_buf);
+	}
+
+	if ( opts->checkpoint != NULL ) checkpoint_write(&checkpoint); //Complete: a restart has nothing left to do
+
+	if ( report != NULL && counters_ok ){
+		report->cache_misses = ( (report->cache_misses > 0) ? report->cache_misses : 0 ) + cache_misses;
+	}
+	REPORT_COUNT(lookups, lookups);
+
+	//Compensated (Kahan) sum of the pair energies: the rounding error of the sum does not grow with the number of
+	//pairs, and stays below that of the reduced precision stores
+	double screened_bound = 0.0;
+	int64_t screened = 0;
+	double compensation = 0.0;
+	for (int ij=0; ij<npairs; ij++){
+		double term = pair_energy[ij] - compensation;
+		double sum = emp2 + term;
+		compensation = (sum - emp2) - term;
+		emp2 = sum;
+		screened_bound += pair_bound[ij];
+		screened += pair_screened[ij];
+	}
+	if ( stats != NULL ){
+		stats->screened_terms = screened;
+		stats->screened_bound = screened_bound;
+		stats->total_terms = (int64_t)nocc*nocc*nvirt*nvirt;
+	}
+
+	free(pair_i);
+	pair_i=NULL;
+	free(pair_j);
+	pair_j=NULL;
+	free(pair_energy);
+	pair_energy=NULL;
+	free(pair_bound);
+	pair_bound=NULL;
+	free(pair_screened);
+	pair_screened=NULL;
+	free(pair_done);
+	pair_done=NULL;
+	free(Q);
+	Q=NULL;
+	free(Q_max);
+	Q_max=NULL;
+	free(Q_sq);
+	Q_sq=NULL;
+	free(S);
+	S=NULL;
+	free(e_occ);
+	e_occ=NULL;
+
+	return emp2;
+}
+
+double mp2_reference_energy(const char* filename, const integrals_options_t* opts, const mp2_options_t* mp2_opts){
+	report_t* report = report_current();
+	report_set_current(NULL);
+
+	integrals_options_t reference = *opts;
+	reference.mp2_precision = STORE_DOUBLE;
+	reference.precision_check = 0;
+	reference.want_hf = 0;
+	reference.want_mp2 = 1;
+
+	mp2_options_t reference_mp2 = *mp2_opts; //Leaves the checkpoint of the run being checked alone
+	reference_mp2.checkpoint = NULL;
+	reference_mp2.restart = 0;
+
+	double emp2 = NAN;
+	integrals_t ints;
+	if ( integrals_load(filename, &reference, &ints) == TREXIO_SUCCESS ) emp2 = mp2_energy(&ints, &reference_mp2, NULL);
+	integrals_free(&ints);
+
+	report_set_current(report);
+	return emp2;
+}
@@ -0,0 +1,104 @@
+#ifndef MP2_H
+#define MP2_H
+
+#include "integrals.h"
+#include "laplace.h"
+
+///////////////////////////////////// MP2 CORRELATION ENERGY //////////////////////////
+//E(MP2) = sum_ij sum_ab (ia|jb) * (2 (ia|jb) - (ib|ja)) / (e_i + e_j - e_a - e_b)
+
+//Kernel evaluating the pair energies
+typedef enum {
+	MP2_ENGINE_SCALAR, //Plain loop over a,b (default)
+	MP2_ENGINE_TILED,  //Loop over (a,b) tiles reading K_ij only, see mp2_pair_energy_tiled
+	MP2_ENGINE_SIMD    //Explicit vector kernel for the instruction set of the CPU (see mp2_simd.c)
+} mp2_engine_t;
+
+//Instruction set of the simd engine
+typedef enum {
+	MP2_ISA_AUTO,    //Best one the CPU supports (default)
+	MP2_ISA_GENERIC, //Plain C, the only one outside x86
+	MP2_ISA_SSE2,
+	MP2_ISA_AVX2,
+	MP2_ISA_AVX512   //AVX-512F
+} mp2_isa_t;
+
+typedef struct {
+	mp2_engine_t engine; //--mp2-engine
+	mp2_isa_t isa;       //Instruction set of the simd engine (--mp2-isa)
+	int tile;            //Tile size of the tiled engine (--mp2-tile N), 0 to pick the fastest at run time
+	int laplace_points;  //Laplace quadrature of the denominators with this many points (--laplace N), 0 for none
+	double screen_tol;   //Skip the rows a of K_ij whose Schwarz bound is below this (--screen TOL), 0 for none
+	const char* checkpoint; //Save the completed pairs to this file (--checkpoint FILE), NULL for none
+	int restart;         //Skip the pairs already in the checkpoint file (--restart)
+} mp2_options_t;
+
+//What a run of mp2_energy measured, for the drivers to print
+typedef struct {
+	int laplace_points;   //0 unless the Laplace quadrature was used
+	double laplace_error; //Largest relative error of the quadrature on the denominator range
+	int tile;             //Tile size used by the tiled engine, 0 for the other engines
+	mp2_isa_t isa;        //Instruction set used by the simd engine, MP2_ISA_AUTO for the other engines
+	int64_t total_terms;    //(i,j,a,b) terms of the active space, nocc^2 nvirt^2
+	int64_t screened_terms; //Those skipped by the screening, counting both (i,j) and (j,i)
+	double screened_bound;  //Upper bound on the absolute energy they would have added
+} mp2_stats_t;
+
+void mp2_default_options(mp2_options_t* opts);
+
+//If argv[*k] is an MP2 option (--mp2-engine scalar|tiled|simd, --mp2-isa NAME, --mp2-tile N|auto, --laplace N, --screen TOL, --checkpoint FILE,
+//--restart) stores it in 'opts', moves *k past its value and returns
+//1. Returns 0 for any other argument. Exits on an invalid value. --restart needs --checkpoint, which the programs
+//check once all the options are parsed.
+int mp2_parse_option(int argc, char** argv, int* k, mp2_options_t* opts);
+
+//Usage string of the MP2 options, to be embedded in the usage message of the programs
+#define MP2_OPTIONS_USAGE "[--mp2-engine scalar|tiled|simd] [--mp2-isa auto|generic|sse2|avx2|avx512] [--mp2-tile N|auto] [--laplace N] [--screen TOL] " \
+	"[--checkpoint FILE] [--restart]"
+
+//Pair energy e_ij, the sum over a,b above for fixed i,j, from the blocks K_ij and K_ji (nvirt*nvirt doubles each),
+//the virtual MO energies and e_ij = e_i + e_j. Only the 'nrows' rows a listed in 'rows' are summed; with 'rows'
+//NULL, the first 'nrows'.
+double mp2_pair_energy(const double* Kij, const double* Kji, const double* e_virt, int nvirt, double e_ij,
+                       const int* rows, int nrows);
+
+#define MP2_TILE_MAX 64 //Largest tile of the tiled engine, whose transposed copy (32 KiB) lives on the stack
+
+//Same pair energy from K_ij alone, in tile x tile blocks of (a,b), tile <= MP2_TILE_MAX. 'keep' (nvirt doubles, NULL for all rows) is 1.0
+//for the rows a to sum and 0.0 for the others.
+double mp2_pair_energy_tiled(const double* Kij, const double* e_virt, int nvirt, double e_ij, const double* keep,
+                             int tile);
+
+//Same pair energy with 1/(e_ij - e_a - e_b) replaced by the Laplace quadrature 'quad'. The orbital energies are
+//shifted by mu, halfway between HOMO and LUMO, so that every factor of the quadrature is at most 1:
+//S[k][a] = exp(-t_k (e_a - mu)) (npoints*nvirt doubles) and e_ij_mu = e_i + e_j - 2 mu.
+double mp2_pair_energy_laplace(const double* Kij, const double* Kji, const double* S, const laplace_quadrature_t* quad,
+                               int nvirt, double e_ij_mu, const int* rows, int nrows);
+
+//Sum over b of one row of a pair, for the a given by e_ija = e_ij - e_a
+typedef double (*mp2_row_kernel_t)(const double* Kij_a, const double* Kji_a, const double* e_virt, int nvirt,
+                                   double e_ija);
+
+//Same pair energy with 'row_kernel', one of those returned by mp2_simd_select
+double mp2_pair_energy_simd(mp2_row_kernel_t row_kernel, const double* Kij, const double* Kji, const double* e_virt,
+                            int nvirt, double e_ij, const int* rows, int nrows);
+
+//Whether this CPU (and build) can run the kernel for 'isa'
+int mp2_simd_supported(mp2_isa_t isa);
+
+//Row kernel for *isa, or for the best supported instruction set with MP2_ISA_AUTO, which is then stored in *isa.
+//Exits if *isa is not supported.
+mp2_row_kernel_t mp2_simd_select(mp2_isa_t* isa);
+
+const char* mp2_isa_name(mp2_isa_t isa);
+
+//Needs a context loaded with want_mp2. With a factorized store (--cholesky) the blocks are rebuilt pair by pair.
+//Uses all the OpenMP threads available; the result does not depend on their number. 'stats' may be NULL.
+//With a checkpoint file the completed pairs are saved as they finish (see checkpoint.h).
+double mp2_energy(const integrals_t* ints, const mp2_options_t* opts, mp2_stats_t* stats);
+
+//MP2 correlation energy of 'filename' read again with the store in double precision, all the other options
+//unchanged: the reference of --precision-check. Not counted in the run report. Returns NAN if the read fails.
+double mp2_reference_energy(const char* filename, const integrals_options_t* opts, const mp2_options_t* mp2_opts);
+
+#endif
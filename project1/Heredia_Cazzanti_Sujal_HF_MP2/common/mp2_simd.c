@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "mp2.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MP2_SIMD_X86
+#include <immintrin.h>
+#endif
+
+///////////////////////////////////// SIMD MP2 ENGINE //////////////////////////
+//One row a of a pair is sum_b K_ij[a][b] (2 K_ij[a][b] - K_ji[a][b]) / (e_ija - e_b), with e_ija = e_i + e_j - e_a
+//broadcast once per row. The rows are summed with explicit vector kernels, compiled for several instruction sets
+//in the same object and picked at run time from what the CPU supports, so one binary uses AVX-512 where available
+//and still runs on SSE2-only machines.
+//With AVX-512 the division is replaced by the 14-bit reciprocal estimate refined with two Newton steps
+//r <- r (2 - d r), each of which doubles the number of correct bits. SSE2 and AVX2 only have a 12-bit single
+//precision estimate, which needs two conversions and three steps: that was no faster than the vector division, which
+//they keep. Two accumulators per kernel hide the latency of the additions.
+
+static double row_generic(const double* Kij_a, const double* Kji_a, const double* e_virt, int nvirt, double e_ija){
+	double row = 0.0;
+	for (int b=0; b<nvirt; b++){
+		row += Kij_a[b] * ( (2.0*Kij_a[b]) - Kji_a[b] ) / (e_ija - e_virt[b]);
+	}
+	return row;
+}
+
+#ifdef MP2_SIMD_X86
+__attribute__((target("sse2")))
+static double row_sse2(const double* Kij_a, const double* Kji_a, const double* e_virt, int nvirt, double e_ija){
+	const __m128d two = _mm_set1_pd(2.0);
+	const __m128d e = _mm_set1_pd(e_ija);
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	int b = 0;
+	for (; b + 4 <= nvirt; b += 4){
+		for (int h=0; h<2; h++){
+			__m128d x = _mm_loadu_pd(Kij_a + b + 2*h);
+			__m128d y = _mm_loadu_pd(Kji_a + b + 2*h);
+			__m128d d = _mm_sub_pd(e, _mm_loadu_pd(e_virt + b + 2*h));
+			__m128d term = _mm_div_pd(_mm_mul_pd(x, _mm_sub_pd(_mm_mul_pd(two, x), y)), d);
+			if ( h == 0 ) acc0 = _mm_add_pd(acc0, term);
+			else acc1 = _mm_add_pd(acc1, term);
+		}
+	}
+	double lane[2];
+	_mm_storeu_pd(lane, _mm_add_pd(acc0, acc1));
+	double row = lane[0] + lane[1];
+	for (; b<nvirt; b++) row += Kij_a[b] * ( (2.0*Kij_a[b]) - Kji_a[b] ) / (e_ija - e_virt[b]);
+	return row;
+}
+
+__attribute__((target("avx2")))
+static double row_avx2(const double* Kij_a, const double* Kji_a, const double* e_virt, int nvirt, double e_ija){
+	const __m256d e = _mm256_set1_pd(e_ija);
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	int b = 0;
+	for (; b + 8 <= nvirt; b += 8){
+		for (int h=0; h<2; h++){
+			__m256d x = _mm256_loadu_pd(Kij_a + b + 4*h);
+			__m256d y = _mm256_loadu_pd(Kji_a + b + 4*h);
+			__m256d d = _mm256_sub_pd(e, _mm256_loadu_pd(e_virt + b + 4*h));
+			__m256d term = _mm256_div_pd(_mm256_mul_pd(x, _mm256_sub_pd(_mm256_add_pd(x, x), y)), d);
+			if ( h == 0 ) acc0 = _mm256_add_pd(acc0, term);
+			else acc1 = _mm256_add_pd(acc1, term);
+		}
+	}
+	double lane[4];
+	_mm256_storeu_pd(lane, _mm256_add_pd(acc0, acc1));
+	double row = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+	for (; b<nvirt; b++) row += Kij_a[b] * ( (2.0*Kij_a[b]) - Kji_a[b] ) / (e_ija - e_virt[b]);
+	return row;
+}
+
+__attribute__((target("avx512f")))
+static double row_avx512(const double* Kij_a, const double* Kji_a, const double* e_virt, int nvirt, double e_ija){
+	const __m512d one = _mm512_set1_pd(1.0);
+	const __m512d e = _mm512_set1_pd(e_ija);
+	__m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+	int b = 0;
+	for (; b + 16 <= nvirt; b += 16){
+		for (int h=0; h<2; h++){
+			__m512d x = _mm512_loadu_pd(Kij_a + b + 8*h);
+			__m512d y = _mm512_loadu_pd(Kji_a + b + 8*h);
+			__m512d d = _mm512_sub_pd(e, _mm512_loadu_pd(e_virt + b + 8*h));
+			__m512d r = _mm512_rcp14_pd(d);
+			for (int n=0; n<2; n++) r = _mm512_fmadd_pd(r, _mm512_fnmadd_pd(d, r, one), r);
+			__m512d term = _mm512_mul_pd(_mm512_mul_pd(x, _mm512_sub_pd(_mm512_add_pd(x, x), y)), r);
+			if ( h == 0 ) acc0 = _mm512_add_pd(acc0, term);
+			else acc1 = _mm512_add_pd(acc1, term);
+		}
+	}
+	//Last nvirt % 16 columns with masked loads: the lanes past the row keep d = 1 and add nothing
+	for (; b<nvirt; b += 8){
+		__mmask8 m = (nvirt - b >= 8) ? 0xFF : (__mmask8)((1u << (nvirt - b)) - 1);
+		__m512d x = _mm512_maskz_loadu_pd(m, Kij_a + b);
+		__m512d y = _mm512_maskz_loadu_pd(m, Kji_a + b);
+		__m512d d = _mm512_mask_sub_pd(one, m, e, _mm512_maskz_loadu_pd(m, e_virt + b));
+		__m512d r = _mm512_rcp14_pd(d);
+		for (int n=0; n<2; n++) r = _mm512_fmadd_pd(r, _mm512_fnmadd_pd(d, r, one), r);
+		acc0 = _mm512_add_pd(acc0, _mm512_mul_pd(_mm512_mul_pd(x, _mm512_sub_pd(_mm512_add_pd(x, x), y)), r));
+	}
+	return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+}
+#endif
+
+int mp2_simd_supported(mp2_isa_t isa){
+	if ( isa == MP2_ISA_GENERIC ) return 1;
+#ifdef MP2_SIMD_X86
+	__builtin_cpu_init();
+	if ( isa == MP2_ISA_SSE2 ) return __builtin_cpu_supports("sse2");
+	if ( isa == MP2_ISA_AVX2 ) return __builtin_cpu_supports("avx2");
+	if ( isa == MP2_ISA_AVX512 ) return __builtin_cpu_supports("avx512f");
+#endif
+	return 0;
+}
+
+mp2_row_kernel_t mp2_simd_select(mp2_isa_t* requested){
+	mp2_isa_t isa = *requested;
+	if ( isa == MP2_ISA_AUTO ){
+		isa = MP2_ISA_GENERIC;
+		if ( mp2_simd_supported(MP2_ISA_SSE2) ) isa = MP2_ISA_SSE2;
+		if ( mp2_simd_supported(MP2_ISA_AVX2) ) isa = MP2_ISA_AVX2;
+		if ( mp2_simd_supported(MP2_ISA_AVX512) ) isa = MP2_ISA_AVX512;
+	}
+	else if ( !mp2_simd_supported(isa) ){
+		printf("This CPU cannot run the %s MP2 kernel\n", mp2_isa_name(isa));
+		exit(1);
+	}
+
+	*requested = isa;
+#ifdef MP2_SIMD_X86
+	if ( isa == MP2_ISA_SSE2 ) return row_sse2;
+	if ( isa == MP2_ISA_AVX2 ) return row_avx2;
+	if ( isa == MP2_ISA_AVX512 ) return row_avx512;
+#endif
+	return row_generic;
+}
+
+const char* mp2_isa_name(mp2_isa_t isa){
+	switch ( isa ){
+		case MP2_ISA_AUTO: return "auto";
+		case MP2_ISA_GENERIC: return "generic";
+		case MP2_ISA_SSE2: return "sse2";
+		case MP2_ISA_AVX2: return "avx2";
+		case MP2_ISA_AVX512: return "avx512";
+	}
+	return "unknown";
+}
+
+double mp2_pair_energy_simd(mp2_row_kernel_t row_kernel, const double* Kij, const double* Kji, const double* e_virt,
+                            int nvirt, double e_ij, const int* rows, int nrows){
+	double pair = 0.0;
+	for (int r=0; r<nrows; r++){
+		int a = (rows != NULL) ? rows[r] : r;
+		pair += row_kernel(Kij + (int64_t)a*nvirt, Kji + (int64_t)a*nvirt, e_virt, nvirt, e_ij - e_virt[a]);
+	}
+	return pair;
+}
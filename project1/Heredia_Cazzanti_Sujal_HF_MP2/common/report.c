@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include "report.h"
+
+static _Thread_local report_t* current = NULL;
+
+static const char* phase_names[REPORT_PHASES] = {
+	"trexio_open", "metadata", "eri_size", "eri_read", "canonicalize", "sort", "ingest", "decompose", "fock", "energy", "teardown"
+};
+
+double report_time(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+void report_init(report_t* report){
+	memset(report, 0, sizeof(*report));
+	report->cache_misses = -1;
+}
+
+int report_counter_open(void){
+#ifdef __linux__
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if ( fd >= 0 ) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+int64_t report_counter_close(int fd){
+	if ( fd < 0 ) return -1;
+	int64_t count = -1;
+#ifdef __linux__
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	if ( read(fd, &count, sizeof(count)) != sizeof(count) ) count = -1;
+#endif
+	close(fd);
+	return count;
+}
+
+void report_set_current(report_t* report){
+	current = report;
+}
+
+report_t* report_current(void){
+	return current;
+}
+
+void report_energy(report_t* report, const char* name, double value){
+	if ( report == NULL || report->nenergies == REPORT_MAX_ENERGIES ) return;
+	report->energy_name[report->nenergies] = name;
+	report->energy[report->nenergies] = value;
+	report->nenergies++;
+}
+
+int report_parse_option(int argc, char** argv, int* k, const char** path){
+	if ( strcmp(argv[*k], "--report") == 0 && *k+1 < argc ){
+		*path = argv[++*k];
+		return 1;
+	}
+	return 0;
+}
+
+//JSON string, escaping what a file name may contain
+static void json_string(FILE* out, const char* text){
+	fputc('"', out);
+	for (const char* c = text; *c != '\0'; c++){
+		if ( *c == '"' || *c == '\\' ) fprintf(out, "\\%c", *c);
+		else if ( (unsigned char)*c < 0x20 ) fprintf(out, "\\u%04x", (unsigned char)*c);
+		else fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+static void write_one(FILE* out, const char* program, const char* file, const report_t* r, long peak_rss_kb,
+                      const char* indent){
+	fprintf(out, "%s{\n", indent);
+	fprintf(out, "%s  \"program\": ", indent);
+	json_string(out, program);
+	fprintf(out, ",\n%s  \"file\": ", indent);
+	json_string(out, file);
+
+	fprintf(out, ",\n%s  \"energies\": {", indent);
+	for (int e=0; e<r->nenergies; e++){
+		fprintf(out, "%s\n%s    ", (e > 0) ? "," : "", indent);
+		json_string(out, r->energy_name[e]);
+		fprintf(out, ": %.15g", r->energy[e]);
+	}
+	fprintf(out, "\n%s  },\n", indent);
+
+	double total = 0.0;
+	fprintf(out, "%s  \"seconds\": {", indent);
+	for (int p=0; p<REPORT_PHASES; p++){
+		fprintf(out, "\n%s    \"%s\": %.6f,", indent, phase_names[p], r->seconds[p]);
+		total += r->seconds[p];
+	}
+	total += r->eri_wait - r->eri_read_background; //The reads of the reader thread only count where they were waited for
+	fprintf(out, "\n%s    \"eri_wait\": %.6f,", indent, r->eri_wait);
+	fprintf(out, "\n%s    \"total\": %.6f\n%s  },\n", indent, total, indent);
+
+	fprintf(out, "%s  \"counters\": {\n", indent);
+	fprintf(out, "%s    \"integrals_read\": %lld,\n", indent, (long long)r->integrals_read);
+	fprintf(out, "%s    \"integrals_used\": %lld,\n", indent, (long long)r->integrals_used);
+	fprintf(out, "%s    \"lookups\": %lld,\n", indent, (long long)r->lookups);
+	fprintf(out, "%s    \"mp2_store_missing\": %lld,\n", indent, (long long)r->store_missing);
+	fprintf(out, "%s    \"arena_high_water_bytes\": %lld,\n", indent, (long long)r->arena_high_water);
+	if ( r->cache_misses >= 0 ) fprintf(out, "%s    \"cache_misses\": %lld\n", indent, (long long)r->cache_misses);
+	else fprintf(out, "%s    \"cache_misses\": null\n", indent);
+	fprintf(out, "%s  },\n", indent);
+	fprintf(out, "%s  \"peak_rss_kb\": %ld\n", indent, peak_rss_kb);
+	fprintf(out, "%s}", indent);
+}
+
+int report_write(const char* path, const char* program, const char* const* files, const report_t* reports, int n){
+	FILE* out = (strcmp(path, "-") == 0) ? stdout : fopen(path, "w");
+	if ( out == NULL ) return 0;
+
+	//Peak resident memory of the whole process (kilobytes on Linux), shared by all the runs of a batch
+	struct rusage usage;
+	long peak_rss_kb = (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : -1;
+
+	if ( n == 1 ){
+		write_one(out, program, files[0], &reports[0], peak_rss_kb, "");
+	}
+	else{
+		fprintf(out, "[\n");
+		for (int f=0; f<n; f++){
+			write_one(out, program, files[f], &reports[f], peak_rss_kb, "  ");
+			fprintf(out, "%s\n", (f < n-1) ? "," : "");
+		}
+		fprintf(out, "]");
+	}
+	fprintf(out, "\n");
+
+	if ( out != stdout ) return fclose(out) == 0;
+	fflush(out);
+	return 1;
+}
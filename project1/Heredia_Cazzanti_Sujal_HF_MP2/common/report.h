@@ -0,0 +1,77 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+///////////////////////////////////// RUN REPORT //////////////////////////
+//Per-phase wall times, counters and energies of a run, written as JSON with --report FILE ('-' for stdout) so that
+//performance regressions show up in the pipeline dashboards without a profiler.
+//The code being measured does not carry the report around: each thread has a "current" report (set by the
+//driver, NULL when no report is asked for) which REPORT_TIME/REPORT_COUNT update.
+
+typedef enum {
+	REPORT_OPEN,          //trexio_open
+	REPORT_METADATA,      //Nuclear repulsion, electrons, MOs, MO energies, core Hamiltonian
+	REPORT_ERI_SIZE,      //trexio_read_mo_2e_int_eri_size
+	REPORT_ERI_READ,      //trexio_read_mo_2e_int_eri
+	REPORT_CANONICALIZE,  //Canonical keys of the ERI table
+	REPORT_SORT,          //Radix sort of the ERI table
+	REPORT_INGEST,        //Scatter of the integrals into the HF/MP2 stores
+	REPORT_DECOMPOSE,     //Cholesky decomposition of the MP2 store
+	REPORT_FOCK,          //J/K build of the Fock matrix
+	REPORT_ENERGY,        //Energy kernels
+	REPORT_TEARDOWN,      //trexio_close and deallocation
+	REPORT_PHASES
+} report_phase_t;
+
+#define REPORT_MAX_ENERGIES 8
+
+typedef struct {
+	double seconds[REPORT_PHASES];
+	double eri_wait;         //Time the ERI consumers waited for the reader thread, within no phase: eri_read runs
+	                         //alongside the consumer phases, and only this part of it was not hidden by them
+	double eri_read_background; //Part of eri_read done by the reader thread. The "total" of the report is the time
+	                         //of the calling thread: the phases minus this overlapped part, plus eri_wait
+	int64_t integrals_read;  //Integrals read from the file (or from its cache)
+	int64_t integrals_used;  //Integrals that went into at least one store
+	int64_t lookups;         //(ia|jb) values read by the MP2 pair kernels, counted per pair by the kernel that ran
+	int64_t store_missing;   //(ia|jb) values of the MP2 store the file does not hold (left at 0), counted at ingest
+	int64_t cache_misses;    //Hardware cache misses of the MP2 kernel, -1 where the counters are not available
+	int64_t arena_high_water; //Peak bytes of the arenas of the integral contexts (see arena.h)
+	int nenergies;
+	const char* energy_name[REPORT_MAX_ENERGIES];
+	double energy[REPORT_MAX_ENERGIES];
+} report_t;
+
+//Wall-clock time in seconds, for differences only
+double report_time(void);
+
+void report_init(report_t* report);
+void report_set_current(report_t* report); //For the calling thread only
+report_t* report_current(void);
+
+void report_energy(report_t* report, const char* name, double value);
+
+//Adds the time elapsed since 'start' (a report_time() value) to 'phase' of the current report
+#define REPORT_TIME(phase, start) do { report_t* r_ = report_current(); \
+	if ( r_ != NULL ) r_->seconds[phase] += report_time() - (start); } while (0)
+
+#define REPORT_COUNT(counter, n) do { report_t* r_ = report_current(); \
+	if ( r_ != NULL ) r_->counter += (n); } while (0)
+
+//Hardware cache-miss counter of the calling thread (Linux perf events), for the kernels that want their misses in
+//the report. Returns -1 if the counters are not available (other systems, or forbidden by perf_event_paranoid).
+int report_counter_open(void);
+//Stops the counter and returns its count, -1 for fd -1
+int64_t report_counter_close(int fd);
+
+//If argv[*k] is --report FILE stores FILE in 'path', moves *k past it and returns 1. Returns 0 otherwise.
+int report_parse_option(int argc, char** argv, int* k, const char** path);
+#define REPORT_OPTIONS_USAGE "[--report FILE]"
+
+//Writes the reports of 'n' runs of 'program' on 'files' to 'path' ('-' for stdout): a JSON object for one run, an
+//array of objects otherwise. Returns 0 if the file cannot be written.
+int report_write(const char* path, const char* program, const char* const* files, const report_t* reports, int n);
+
+#endif
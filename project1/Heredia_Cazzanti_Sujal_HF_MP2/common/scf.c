@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "scf.h"
+#include "fock.h"
+#include "report.h"
+
+#define JACOBI_MAX_SWEEPS 100
+
+void scf_default_options(scf_options_t* opts){
+	opts->enabled = 0;
+	opts->guess = SCF_GUESS_FILE;
+	opts->diis = SCF_DIIS_DEFAULT;
+	opts->max_iter = 100;
+	opts->energy_tol = 1e-10;
+	opts->error_tol = 1e-8;
+}
+
+int scf_parse_option(int argc, char** argv, int* k, scf_options_t* opts){
+	if ( strcmp(argv[*k], "--scf") == 0 ){
+		opts->enabled = 1;
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--scf-guess") == 0 && *k+1 < argc ){
+		const char* name = argv[++*k];
+		if ( strcmp(name, "file") == 0 ) opts->guess = SCF_GUESS_FILE;
+		else if ( strcmp(name, "core") == 0 ) opts->guess = SCF_GUESS_CORE;
+		else{
+			printf("Invalid --scf-guess value: %s\n", name);
+			exit(1);
+		}
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--diis") == 0 && *k+1 < argc ){
+		char* end;
+		opts->diis = (int)strtol(argv[++*k], &end, 10);
+		if ( *end != '\0' || opts->diis < 0 || opts->diis > SCF_DIIS_MAX ){
+			printf("Invalid --diis value: %s\n", argv[*k]);
+			exit(1);
+		}
+		return 1;
+	}
+	if ( strcmp(argv[*k], "--scf-max-iter") == 0 && *k+1 < argc ){
+		char* end;
+		opts->max_iter = (int)strtol(argv[++*k], &end, 10);
+		if ( *end != '\0' || opts->max_iter < 1 ){
+			printf("Invalid --scf-max-iter value: %s\n", argv[*k]);
+			exit(1);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+///////////////////////////////////// EIGENVECTORS //////////////////////////
+//Eigenvalues 'w' (ascending) and eigenvectors of the symmetric n x n matrix A, which is overwritten, by cyclic Jacobi
+//rotations. Column k of V (V[p*n + k]) is the eigenvector of w[k]. O(n^3) per sweep and a few sweeps: the MO bases
+//of our molecules are small enough to need no LAPACK.
+static void jacobi_eigen(int n, double* A, double* w, double* V){
+	for (int p=0; p<n; p++){
+		for (int q=0; q<n; q++) V[p*n + q] = (p == q) ? 1.0 : 0.0;
+	}
+	double norm = 0.0;
+	for (int pq=0; pq<n*n; pq++) norm += A[pq]*A[pq];
+
+	for (int sweep=0; sweep<JACOBI_MAX_SWEEPS; sweep++){
+		double off = 0.0;
+		for (int p=0; p<n; p++){
+			for (int q=p+1; q<n; q++) off += 2*A[p*n + q]*A[p*n + q];
+		}
+		if ( off <= 1e-30*norm ) break;
+
+		for (int p=0; p<n; p++){
+			for (int q=p+1; q<n; q++){
+				double apq = A[p*n + q];
+				if ( apq == 0.0 ) continue;
+				//Rotation zeroing A[p][q]: t = tan of the angle, the smaller root
+				double theta = (A[q*n + q] - A[p*n + p]) / (2*apq);
+				double t = ( (theta >= 0) ? 1.0 : -1.0 ) / ( fabs(theta) + sqrt(theta*theta + 1.0) );
+				double c = 1.0/sqrt(t*t + 1.0);
+				double s = t*c;
+				for (int k=0; k<n; k++){
+					double akp = A[k*n + p], akq = A[k*n + q];
+					A[k*n + p] = c*akp - s*akq;
+					A[k*n + q] = s*akp + c*akq;
+				}
+				for (int k=0; k<n; k++){
+					double apk = A[p*n + k], aqk = A[q*n + k];
+					A[p*n + k] = c*apk - s*aqk;
+					A[q*n + k] = s*apk + c*aqk;
+				}
+				for (int k=0; k<n; k++){
+					double vkp = V[k*n + p], vkq = V[k*n + q];
+					V[k*n + p] = c*vkp - s*vkq;
+					V[k*n + q] = s*vkp + c*vkq;
+				}
+			}
+		}
+	}
+
+	//Ascending order, columns of V along
+	for (int k=0; k<n; k++) w[k] = A[k*n + k];
+	for (int k=0; k<n; k++){
+		int lowest = k;
+		for (int l=k+1; l<n; l++) if ( w[l] < w[lowest] ) lowest = l;
+		if ( lowest == k ) continue;
+		double tw = w[k]; w[k] = w[lowest]; w[lowest] = tw;
+		for (int p=0; p<n; p++){
+			double tv = V[p*n + k];
+			V[p*n + k] = V[p*n + lowest];
+			V[p*n + lowest] = tv;
+		}
+	}
+}
+
+//D = 2 C_occ C_occ^T from the 'o' lowest eigenvectors of the symmetric F. 'A', 'w' and 'V' are scratch.
+static void density_from_fock(int n, int o, const double* F, double* D, double* A, double* w, double* V){
+	memcpy(A, F, (size_t)n*n*sizeof(double));
+	jacobi_eigen(n, A, w, V);
+	for (int p=0; p<n; p++){
+		for (int q=0; q<n; q++){
+			double sum = 0.0;
+			for (int k=0; k<o; k++) sum += V[p*n + k]*V[q*n + k];
+			D[p*n + q] = 2*sum;
+		}
+	}
+}
+
+//Error vector FD - DF (FDS - SDF with S = 1) into 'E'. Returns its largest element.
+static double commutator(int n, const double* F, const double* D, double* E){
+	double largest = 0.0;
+	for (int p=0; p<n; p++){
+		for (int q=0; q<n; q++){
+			double fd = 0.0, df = 0.0;
+			for (int k=0; k<n; k++){
+				fd += F[p*n + k]*D[k*n + q];
+				df += D[p*n + k]*F[k*n + q];
+			}
+			E[p*n + q] = fd - df;
+			largest = fmax(largest, fabs(fd - df));
+		}
+	}
+	return largest;
+}
+
+///////////////////////////////////// DIIS //////////////////////////
+//The last 'max' Fock matrices and their error vectors. The extrapolated Fock matrix sum_k c_k F_k minimizes
+//|sum_k c_k e_k| with sum_k c_k = 1, a (m+1) x (m+1) linear system with a Lagrange multiplier.
+typedef struct {
+	int max;      //Slots
+	int count;    //Matrices added so far, the newest in slot (count-1) % max
+	size_t size;  //Elements of one matrix
+	double* F;    //[max*size]
+	double* E;    //[max*size]
+} diis_t;
+
+static void diis_init(diis_t* diis, int max, size_t size){
+	diis->max = max;
+	diis->count = 0;
+	diis->size = size;
+	diis->F = integrals_alloc((size_t)(max > 0 ? max : 1)*size);
+	diis->E = integrals_alloc((size_t)(max > 0 ? max : 1)*size);
+}
+
+static void diis_free(diis_t* diis){
+	free(diis->F);
+	diis->F=NULL;
+	free(diis->E);
+	diis->E=NULL;
+}
+
+//Solves the n x n system A x = b in place (x in b) by Gaussian elimination with partial pivoting. Returns 0 if A is
+//singular, i.e. if a pivot falls below SCF_PIVOT_TOL times the largest diagonal element: the overlaps of the error
+//vectors shrink with them, so an absolute bound would never trigger.
+#define SCF_PIVOT_TOL 1e-12
+static int solve_linear(int n, double* A, double* b){
+	double scale = 0.0;
+	for (int c=0; c<n; c++) if ( fabs(A[c*n + c]) > scale ) scale = fabs(A[c*n + c]);
+	if ( scale == 0.0 ) return 0;
+	for (int c=0; c<n; c++){
+		int pivot = c;
+		for (int r=c+1; r<n; r++) if ( fabs(A[r*n + c]) > fabs(A[pivot*n + c]) ) pivot = r;
+		if ( fabs(A[pivot*n + c]) < SCF_PIVOT_TOL*scale ) return 0;
+		if ( pivot != c ){
+			for (int k=0; k<n; k++){
+				double t = A[c*n + k]; A[c*n + k] = A[pivot*n + k]; A[pivot*n + k] = t;
+			}
+			double t = b[c]; b[c] = b[pivot]; b[pivot] = t;
+		}
+		for (int r=c+1; r<n; r++){
+			double f = A[r*n + c]/A[c*n + c];
+			for (int k=c; k<n; k++) A[r*n + k] -= f*A[c*n + k];
+			b[r] -= f*b[c];
+		}
+	}
+	for (int r=n-1; r>=0; r--){
+		for (int k=r+1; k<n; k++) b[r] -= A[r*n + k]*b[k];
+		b[r] /= A[r*n + r];
+	}
+	return 1;
+}
+
+//Slot of the k-th of the last m matrices, from the oldest
+static inline size_t diis_slot(const diis_t* diis, int m, int k){
+	return (size_t)((diis->count - m + k) % diis->max);
+}
+
+//Adds (F, E) and writes the extrapolated Fock matrix into 'Fx'. The oldest matrices are dropped while the system is
+//singular (nearly linearly dependent error vectors); with one left, Fx = F.
+static void diis_extrapolate(diis_t* diis, const double* F, const double* E, double* Fx){
+	size_t size = diis->size;
+	size_t slot = (size_t)(diis->count % diis->max);
+	memcpy(diis->F + slot*size, F, size*sizeof(double));
+	memcpy(diis->E + slot*size, E, size*sizeof(double));
+	diis->count++;
+
+	int m = (diis->count < diis->max) ? diis->count : diis->max;
+	double A[(SCF_DIIS_MAX + 1)*(SCF_DIIS_MAX + 1)], c[SCF_DIIS_MAX + 1];
+	int first = 0; //Oldest matrix used, 0 the oldest one kept
+	for (; first < m-1; first++){
+		int n = m - first;
+		for (int k=0; k<n; k++){
+			for (int l=0; l<=k; l++){
+				const double* ek = diis->E + diis_slot(diis, m, first + k)*size;
+				const double* el = diis->E + diis_slot(diis, m, first + l)*size;
+				double dot = 0.0;
+				for (size_t x=0; x<size; x++) dot += ek[x]*el[x];
+				A[k*(n+1) + l] = A[l*(n+1) + k] = dot;
+			}
+			A[k*(n+1) + n] = A[n*(n+1) + k] = -1.0;
+			c[k] = 0.0;
+		}
+		A[n*(n+1) + n] = 0.0;
+		c[n] = -1.0;
+		if ( !solve_linear(n+1, A, c) ) continue;
+
+		memset(Fx, 0, size*sizeof(double));
+		for (int k=0; k<n; k++){
+			const double* Fk = diis->F + diis_slot(diis, m, first + k)*size;
+			for (size_t x=0; x<size; x++) Fx[x] += c[k]*Fk[x];
+		}
+		return;
+	}
+	memcpy(Fx, F, size*sizeof(double));
+}
+
+///////////////////////////////////// ITERATIONS //////////////////////////
+//Core Hamiltonian guess: the density of the lowest eigenvectors of h
+static void core_guess(const integrals_t* ints, double* D, double* A, double* w, double* V){
+	density_from_fock(ints->mo, ints->num_elec, ints->core_h, D, A, w, V);
+}
+
+int scf_run(const integrals_t* ints, const scf_options_t* opts, scf_result_t* result){
+	int n = ints->mo;
+	int o = ints->num_elec;
+	size_t mm = (size_t)n*n;
+	double* D = integrals_alloc(mm);      //Current density
+	double* D_new = integrals_alloc(mm);
+	double* F = integrals_alloc(mm);      //F(D)
+	double* Fx = integrals_alloc(mm);     //Extrapolated Fock matrix
+	double* E = integrals_alloc(mm);      //FD - DF
+	double* J = integrals_alloc(mm);
+	double* K = integrals_alloc(mm);
+	double* A = integrals_alloc(mm);      //Eigensolver scratch
+	double* V = integrals_alloc(mm);
+	double* w = integrals_alloc((size_t)n);
+	int diis_max = opts->diis;
+	diis_t diis;
+	diis_init(&diis, diis_max, mm);
+
+	double start = report_time();
+	memset(result, 0, sizeof(*result));
+	if ( opts->guess == SCF_GUESS_CORE ) core_guess(ints, D, A, w, V);
+	else fock_density(ints, D);
+	fock_build(ints, D, F);
+	result->full_builds = 1;
+	int since_full = 0; //Incremental builds since the last full one
+	double energy = fock_energy(ints, D, F);
+	double dE = HUGE_VAL;
+	double error = commutator(n, F, D, E); //Of the current iterate, also fed to DIIS
+	printf("SCF initial energy (%s guess): %.10f \n", (opts->guess == SCF_GUESS_CORE) ? "core" : "file", energy);
+
+	for (;;){
+		if ( fabs(dE) < opts->energy_tol && error < opts->error_tol && since_full > 0 ){
+			//Converged on an incrementally built F: confirmed with the exact one
+			fock_build(ints, D, F);
+			result->full_builds++;
+			since_full = 0;
+			double exact = fock_energy(ints, D, F);
+			dE = exact - energy;
+			energy = exact;
+			error = commutator(n, F, D, E);
+		}
+		if ( fabs(dE) < opts->energy_tol && error < opts->error_tol ){
+			result->converged = 1;
+			break;
+		}
+		if ( result->iterations == opts->max_iter ) break;
+		result->iterations++;
+		double t0 = report_time();
+
+		//- Next density, from the DIIS extrapolation of the Fock matrices
+		if ( diis_max > 1 ) diis_extrapolate(&diis, F, E, Fx);
+		else memcpy(Fx, F, mm*sizeof(double));
+		density_from_fock(n, o, Fx, D_new, A, w, V);
+
+		//- Its Fock matrix: the previous one plus G of the density change, rebuilt whole from time to time
+		int full = ( since_full + 1 >= SCF_REBUILD_INTERVAL );
+		if ( full ){
+			fock_build(ints, D_new, F);
+			result->full_builds++;
+			since_full = 0;
+		}
+		else{
+			for (size_t pq=0; pq<mm; pq++) D[pq] = D_new[pq] - D[pq];
+			double t1 = report_time();
+			fock_jk(ints, D, SCF_INCREMENT_TOL, J, K);
+			REPORT_TIME(REPORT_FOCK, t1);
+			for (size_t pq=0; pq<mm; pq++) F[pq] += J[pq] - 0.5*K[pq];
+			since_full++;
+		}
+		memcpy(D, D_new, mm*sizeof(double));
+
+		double next = fock_energy(ints, D, F);
+		dE = next - energy;
+		energy = next;
+		error = commutator(n, F, D, E);
+		printf("SCF iteration %3d: E = %.10f, dE = %.3e, error = %.3e, %s Fock build, %.4f s \n", result->iterations,
+		       energy, dE, error, full ? "full" : "incremental", report_time() - t0);
+	}
+	result->energy = energy;
+	result->seconds = report_time() - start;
+
+	diis_free(&diis);
+	free(D);
+	free(D_new);
+	free(F);
+	free(Fx);
+	free(E);
+	free(J);
+	free(K);
+	free(A);
+	free(V);
+	free(w);
+	return result->converged;
+}
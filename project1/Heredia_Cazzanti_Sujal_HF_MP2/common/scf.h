@@ -0,0 +1,56 @@
+#ifndef SCF_H
+#define SCF_H
+
+#include "integrals.h"
+
+///////////////////////////////////// SCF SOLVER //////////////////////////
+//Closed-shell Roothaan-Hall iterations in the orthonormal MO basis of the file (S = 1): F(D) is diagonalized, its
+//num_elec lowest eigenvectors give the next density D = 2 C_occ C_occ^T, until the energy and the commutator
+//FD - DF stop changing. Two things make the iterations fewer and cheaper:
+//- Pulay DIIS: the Fock matrix that is diagonalized is the combination of the last ones whose commutators
+//  (the error vectors) extrapolate to zero.
+//- Incremental Fock build: F(D_n) = F(D_n-1) + G(D_n - D_n-1), with G = J - K/2 linear in D, so only the density
+//  change is contracted with the integrals and the ones too small for it are skipped (see fock_jk). A full build
+//  every SCF_REBUILD_INTERVAL iterations, and before convergence is accepted, removes the screening errors.
+//Each iteration is logged with its energy, its changes and its time.
+
+#ifndef SCF_REBUILD_INTERVAL
+#define SCF_REBUILD_INTERVAL 8 //Iterations between two full Fock builds
+#endif
+#define SCF_INCREMENT_TOL 1e-12  //Integrals skipped by the incremental builds: |(pq|rs)| max|D_n - D_n-1| below this
+#define SCF_DIIS_DEFAULT 8       //Fock matrices kept by DIIS
+#define SCF_DIIS_MAX 16          //Largest --diis
+
+typedef enum {
+	SCF_GUESS_FILE, //Density of the occupied orbitals of the file
+	SCF_GUESS_CORE  //Occupied eigenvectors of the core Hamiltonian
+} scf_guess_t;
+
+typedef struct {
+	int enabled;       //Run the SCF (--scf)
+	scf_guess_t guess; //Starting density (--scf-guess file|core)
+	int diis;          //Fock matrices kept by DIIS, 0 or 1 turns it off (--diis N)
+	int max_iter;      //Iterations before giving up (--scf-max-iter N)
+	double energy_tol; //Convergence: energy change...
+	double error_tol;  //...and largest element of FD - DF
+} scf_options_t;
+
+typedef struct {
+	double energy;      //E(HF) = Vnn + 1/2 Tr[D(h+F)] of the last density
+	int iterations;
+	int converged;
+	int full_builds;    //Fock builds over the whole table, the others were incremental
+	double seconds;     //Total time, the guess and its Fock build included
+} scf_result_t;
+
+void scf_default_options(scf_options_t* opts);
+
+//If argv[*k] is an SCF option (--scf, --scf-guess file|core, --diis N, --scf-max-iter N) stores it in 'opts',
+//moves *k past its value and returns 1. Returns 0 for any other argument. Exits on an invalid value.
+int scf_parse_option(int argc, char** argv, int* k, scf_options_t* opts);
+#define SCF_OPTIONS_USAGE "[--scf] [--scf-guess file|core] [--diis N] [--scf-max-iter N]"
+
+//Runs the SCF on a context loaded with want_fock. Returns 1 if it converged.
+int scf_run(const integrals_t* ints, const scf_options_t* opts, scf_result_t* result);
+
+#endif
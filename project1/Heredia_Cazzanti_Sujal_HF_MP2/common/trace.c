@@ -0,0 +1,136 @@
+#include "trace.h"
+
+#if TRACE_LEVEL > 0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define TRACE_RING_SIZE (1 << 20)    //Bytes buffered per thread
+#define TRACE_MESSAGE_MAX 512        //Longer messages are truncated
+#define TRACE_FLUSH_PERIOD_NS 5000000 //The flusher wakes up every 5 ms
+
+//Single-producer single-consumer ring: the owning thread moves 'head', the flusher moves 'tail'. Both only grow,
+//the position in 'data' is taken modulo the size. 'head' is published after a whole message is copied, so the
+//flusher always writes complete messages.
+typedef struct trace_ring {
+	char data[TRACE_RING_SIZE];
+	_Atomic size_t head;
+	_Atomic size_t tail;
+	struct trace_ring* next; //Registry of all the rings, newest first
+} trace_ring_t;
+
+static _Thread_local trace_ring_t* my_ring = NULL;
+static _Atomic(trace_ring_t*) rings = NULL;
+
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+static pthread_t flusher;
+static _Atomic int stopping = 0;
+static FILE* out = NULL;
+static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER; //Serializes the flusher and the final drain
+
+//Writes out everything the ring holds. Called with 'out_lock' held.
+static void drain(trace_ring_t* ring){
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	while ( tail != head ){
+		size_t start = tail % TRACE_RING_SIZE;
+		size_t len = head - tail;
+		if ( start + len > TRACE_RING_SIZE ) len = TRACE_RING_SIZE - start; //Up to the wrap-around point
+		fwrite(ring->data + start, 1, len, out);
+		tail += len;
+	}
+	atomic_store_explicit(&ring->tail, tail, memory_order_release);
+}
+
+static void drain_all(void){
+	pthread_mutex_lock(&out_lock);
+	for (trace_ring_t* ring = atomic_load(&rings); ring != NULL; ring = ring->next) drain(ring);
+	fflush(out);
+	pthread_mutex_unlock(&out_lock);
+}
+
+static void* flusher_main(void* arg){
+	(void)arg;
+	struct timespec period = { 0, TRACE_FLUSH_PERIOD_NS };
+	while ( !atomic_load(&stopping) ){
+		nanosleep(&period, NULL);
+		drain_all();
+	}
+	return NULL;
+}
+
+static void trace_stop(void){
+	atomic_store(&stopping, 1);
+	pthread_join(flusher, NULL);
+	drain_all();
+
+	trace_ring_t* ring = atomic_load(&rings);
+	while ( ring != NULL ){
+		trace_ring_t* next = ring->next;
+		free(ring);
+		ring = next;
+	}
+	if ( out != stderr ) fclose(out);
+}
+
+static void trace_start(void){
+	const char* path = getenv("TRACE_FILE");
+	out = (path != NULL) ? fopen(path, "w") : NULL;
+	if ( out == NULL ) out = stderr;
+
+	if ( pthread_create(&flusher, NULL, flusher_main, NULL) != 0 ){
+		fprintf(stderr, "Cannot start the trace flusher thread\n");
+		exit(1);
+	}
+	atexit(trace_stop);
+}
+
+//The ring of the calling thread, created on its first message. Rings are never unlinked: the ones of finished
+//threads are still drained, and all of them are freed at exit.
+static trace_ring_t* thread_ring(void){
+	if ( my_ring == NULL ){
+		pthread_once(&start_once, trace_start);
+		my_ring = calloc(1, sizeof(trace_ring_t));
+		if ( my_ring == NULL ){
+			printf("Memory allocation went wrong");
+			exit(1);
+		}
+		trace_ring_t* head = atomic_load(&rings);
+		do {
+			my_ring->next = head;
+		} while ( !atomic_compare_exchange_weak(&rings, &head, my_ring) );
+	}
+	return my_ring;
+}
+
+void trace_write(const char* format, ...){
+	char message[TRACE_MESSAGE_MAX];
+	va_list args;
+	va_start(args, format);
+	int len = vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+	if ( len <= 0 ) return;
+	if ( len >= TRACE_MESSAGE_MAX ) len = TRACE_MESSAGE_MAX - 1;
+
+	trace_ring_t* ring = thread_ring();
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	//Ring full: wait for the flusher rather than losing messages
+	while ( head + len - atomic_load_explicit(&ring->tail, memory_order_acquire) > TRACE_RING_SIZE ){
+		sched_yield();
+	}
+
+	size_t start = head % TRACE_RING_SIZE;
+	size_t first = ((size_t)len < TRACE_RING_SIZE - start) ? (size_t)len : TRACE_RING_SIZE - start;
+	memcpy(ring->data + start, message, first);
+	memcpy(ring->data, message + first, len - first);
+	atomic_store_explicit(&ring->head, head + len, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+///////////////////////////////////// DIAGNOSTIC TRACE //////////////////////////
+//Diagnostic messages (which integrals are picked, program phases, ...) go through TRACE(level, format, ...).
+//The trace level is fixed at compile time with -DTRACE_LEVEL=n (the same value for all files):
+//  0 (default)  no trace: TRACE compiles to nothing, its arguments are not even evaluated
+//  1            program phases
+//  2            also one message per integral used by the HF energy
+//When enabled, messages are formatted into a ring buffer owned by the calling thread and a background thread
+//writes the buffers out (to stderr, or to the file named by the TRACE_FILE environment variable), so the hot
+//loops never wait for terminal I/O. Whatever is left is written at exit.
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL 0
+#endif
+
+#define TRACE_PHASE 1
+#define TRACE_INTEGRAL 2
+
+#if TRACE_LEVEL > 0
+void trace_write(const char* format, ...) __attribute__((format(printf, 1, 2)));
+#define TRACE(level, ...) do { if ( (level) <= TRACE_LEVEL ) trace_write(__VA_ARGS__); } while (0)
+#else
+#define TRACE(level, ...) ((void)0)
+#endif
+
+#endif